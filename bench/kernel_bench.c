@@ -0,0 +1,631 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+/*
+* Micro benchmark of the decoder's hot kernels, each one alone on synthetic input.
+* The kernels are static, so their sources are built into this file instead of being linked.
+*
+* kernel_bench [--runs N] [--pin CPU] [--save out.json] [--baseline in.json [--tolerance PCT]] [name...]
+* kernel_bench --check
+*
+* Every kernel is run in batches of at least MIN_BATCH_NS, the fastest batch gives ns_per_call.
+* With --baseline a kernel slower than its baseline ns_per_call by more than the tolerance is
+* a regression, reported on stderr with exit code 1.
+* --check runs no benchmark, it compares the specialized kernels with their generic form, exit code 1 if one differs.
+*/
+#include "../mini_mpgPlayer/layer3.c"
+#include "../mini_mpgPlayer/synth.c"
+#include "../mini_mpgPlayer/thread.h"
+
+#define DEFAULT_RUNS		15
+#define DEFAULT_TOLERANCE	10.0
+#define MIN_BATCH_NS		2000000
+
+#define BITS_BYTES			65536
+#define HUFF_TABLES			34		// 0 - 31 big_values, 32 + count1table_select
+#define HUFF_STREAM_BYTES	8192
+
+struct kernel {
+	char name[32];
+	void (*run)(const struct kernel* k, uint32_t calls);
+	int arg;
+	double items_per_call;
+	const char* unit;
+
+	double ns_per_call;		// fastest batch
+	double median_ns;
+};
+
+static uint8_t bits_data[BITS_BYTES + 8];
+static uint8_t widths[4096];
+static double widths_mean;
+
+static uint8_t huff_data[HUFF_TABLES][HUFF_STREAM_BYTES];
+static uint16_t huff_bits[HUFF_TABLES];
+
+static uint8_t sideinfo_data[32 + 8];	// stereo, long blocks
+static short bench_is[SBLIMIT * SSLIMIT];	// requantize input, decoded with table 13
+static short huff_out[SBLIMIT * SSLIMIT];
+static unsigned bench_scf[39];
+static float bench_xr[2][SBLIMIT * SSLIMIT], bench_xr_src[2][SBLIMIT * SSLIMIT];
+static MMP_ALIGN(16) float bench_s[SSLIMIT][SBLIMIT];
+static uint8_t bench_pcm_buf[SSLIMIT * SBLIMIT * 2 * 2];
+static struct pcm_stream bench_pcm;
+static struct decoder_diag bench_diag;	// counters only
+
+// keeps the results alive
+static volatile float sink;
+
+static uint32_t rand_state = 0x12345678;
+static uint32_t rand_next(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static float rand_float(void)
+{
+	return (int32_t)rand_next() * (1.0f / 2147483648.0f);
+}
+
+static void put_bits(uint8_t* const buf, uint32_t* const pos, const uint32_t value, const uint32_t n)
+{
+	for (uint32_t i = n; i--; ++*pos) {
+		if (value >> i & 1)
+			buf[*pos >> 3] |= 0x80 >> (*pos & 7);
+	}
+}
+
+// the leaf reached by a random path through the tree, its bits appended
+static uint16_t put_codeword(const struct huff_tab* const htab, uint8_t* const buf, uint32_t* const pos)
+{
+	uint16_t point = 0;
+
+	while (htab->table[point] & 0xff00) {
+		if (rand_next() & 0x10000) {
+			put_bits(buf, pos, 1, 1);
+			while ((htab->table[point] & 0xff) >= 250)
+				point += htab->table[point] & 0xff;
+			point += htab->table[point] & 0xff;
+		} else {
+			put_bits(buf, pos, 0, 1);
+			while ((htab->table[point] >> 8) >= 250)
+				point += htab->table[point] >> 8;
+			point += htab->table[point] >> 8;
+		}
+	}
+
+	return htab->table[point];
+}
+
+static void put_value(const unsigned v, const uint8_t linbits, uint8_t* const buf, uint32_t* const pos)
+{
+	if (linbits && v == 15)
+		put_bits(buf, pos, rand_next() >> 8, linbits);
+	if (v)
+		put_bits(buf, pos, rand_next() >> 8 & 1, 1);
+}
+
+/*
+* Valid granules from random walks through each code tree: the values come in the proportions the code
+* lengths imply, 576 big values or 144 count1 quadruples exactly filling part3.
+*/
+static void make_huffman_streams(void)
+{
+	int t;
+
+	for (t = 0; t < HUFF_TABLES; ++t) {
+		uint8_t* const buf = huff_data[t];
+		uint32_t pos = 0, i;
+
+		if (t < 32) {
+			const struct huff_tab* const htab = ht + t;
+			if (!htab->treelen)
+				continue;
+			for (i = 0; i < SBLIMIT * SSLIMIT / 2; ++i) {
+				const uint16_t leaf = put_codeword(htab, buf, &pos);
+				put_value(leaf >> 4 & 0xf, htab->linbits, buf, &pos);
+				put_value(leaf & 0xf, htab->linbits, buf, &pos);
+			}
+		} else {
+			for (i = 0; i < SBLIMIT * SSLIMIT / 4; ++i) {
+				const uint16_t leaf = put_codeword(htc + t - 32, buf, &pos);
+				for (int b = 3; b >= 0; --b)
+					put_value(leaf >> b & 1, 0, buf, &pos);
+			}
+		}
+		huff_bits[t] = (uint16_t)pos;
+	}
+}
+
+// the table driven loop with linbits for every table, what the per class loops of l3_huffman_decode have to match
+L3_HUFFMAN_PAIRS(check_huffman_pairs, htab->table, htab->treelen, 1)
+
+static struct ch_info huffman_ch(const int t)
+{
+	struct ch_info ch = { 0 };
+
+	ch.part2_3_len = huff_bits[t];
+	if (t < 32) {
+		ch.big_values = SBLIMIT * SSLIMIT / 2;
+		ch.table_select[0] = ch.table_select[1] = ch.table_select[2] = (uint8_t)t;
+		ch.region0_count = 7;
+		ch.region1_count = 7;
+	} else ch.count1table_select = (uint8_t)(t - 32);
+
+	return ch;
+}
+
+static void make_input(void)
+{
+	struct mpeg_header header = { 0 };	// 44.1 kHz
+	struct ch_info ch;
+	struct bs s = { 0 };
+	int i, j;
+
+	l3_init(&header);
+
+	for (i = 0; i < BITS_BYTES; ++i)
+		bits_data[i] = (uint8_t)rand_next();
+	for (i = 0; i < 4096; ++i) {
+		widths[i] = 2 + rand_next() % 16;
+		widths_mean += widths[i] / 4096.0;
+	}
+
+	for (i = 0; i < 32; ++i)
+		sideinfo_data[i] = (uint8_t)rand_next();
+	// win_switch_flag of every granule and channel cleared, 33 bits into each 59 after the first 20
+	for (i = 0; i < 4; ++i) {
+		const int bit = 20 + 59 * i + 33;
+		sideinfo_data[bit >> 3] &= ~(0x80 >> (bit & 7));
+	}
+
+	make_huffman_streams();
+	ch = huffman_ch(13);
+	s.byte_ptr = huff_data[13];
+	l3_huffman_decode(&s, &ch, bench_is, &bench_diag);
+
+	for (i = 0; i < 39; ++i)
+		bench_scf[i] = rand_next() % 16;
+	for (i = 0; i < SBLIMIT * SSLIMIT; ++i) {
+		bench_xr_src[0][i] = rand_float();
+		bench_xr_src[1][i] = rand_float();
+	}
+	memcpy(bench_xr, bench_xr_src, sizeof(bench_xr));
+	for (i = 0; i < SSLIMIT; ++i)
+		for (j = 0; j < SBLIMIT; ++j)
+			bench_s[i][j] = rand_float() * 0.1f;
+
+	bench_pcm.pcm_buf = bench_pcm_buf;
+	bench_pcm.audio_buf_size = bench_pcm.pcm_buf_size = sizeof(bench_pcm_buf);
+	bench_pcm.format = SAMPLE_S16;
+	bench_pcm.channels = 2;
+	bench_pcm.sample_size = 2;
+}
+
+static void run_readBit(const struct kernel* const k, uint32_t calls)
+{
+	struct bs s = { 0 };
+	uint32_t sum = 0;
+
+	while (calls) {
+		uint32_t n = calls < BITS_BYTES * 8 ? calls : BITS_BYTES * 8;
+		calls -= n;
+		s.byte_ptr = bits_data;
+		s.bit_pos = 0;
+		while (n--)
+			sum += bs_readBit(&s);
+	}
+	sink = (float)sum;
+	(void)k;
+}
+
+static void run_readBits(const struct kernel* const k, uint32_t calls)
+{
+	struct bs s = { 0 };
+	uint32_t sum = 0, i;
+
+	while (calls) {
+		const uint32_t n = calls < 4096 ? calls : 4096;
+		calls -= n;
+		s.byte_ptr = bits_data;
+		s.bit_pos = 0;
+		for (i = 0; i < n; ++i)
+			sum += bs_readBits(&s, widths[i]);
+	}
+	sink = (float)sum;
+	(void)k;
+}
+
+static void run_sideinfo(const struct kernel* const k, uint32_t calls)
+{
+	struct l3_sideinfo si;
+	struct bs s = { 0 };
+	uint32_t sum = 0;
+
+	while (calls--) {
+		s.byte_ptr = sideinfo_data;
+		s.bit_pos = 0;
+		sum += l3_decode_sideinfo(&s, &si, 2, &bench_diag);
+		sum += si.gr[1].ch[1].part2_3_len;
+	}
+	sink = (float)sum;
+	(void)k;
+}
+
+static void run_huffman(const struct kernel* const k, uint32_t calls)
+{
+	struct ch_info ch = huffman_ch(k->arg);
+	struct bs s = { 0 };
+
+	while (calls--) {
+		s.byte_ptr = huff_data[k->arg];
+		s.bit_pos = 0;
+		l3_huffman_decode(&s, &ch, huff_out, &bench_diag);
+	}
+	sink = huff_out[ch.nonzero_len - 1];
+}
+
+static void run_requantize(const struct kernel* const k, uint32_t calls)
+{
+	const struct mpeg_frame frame = { 0 };
+	struct ch_info ch = huffman_ch(13);
+
+	ch.global_gain = 150;
+	ch.nonzero_len = SBLIMIT * SSLIMIT;
+	while (calls--)
+		l3_requantize(&ch, &frame, bench_is, bench_scf, bench_xr[0]);
+	sink = bench_xr[0][k->arg];
+}
+
+// the side channel requantized into the M/S reconstruction, against l3_requantize + l3_do_ms_stereo
+static void run_requantize_ms(const struct kernel* const k, uint32_t calls)
+{
+	struct ch_info ch = huffman_ch(13);
+
+	ch.global_gain = 150;
+	ch.nonzero_len = SBLIMIT * SSLIMIT;
+	while (calls--)
+		l3_requantize_ms(&ch, bench_is, bench_scf, bench_xr);
+	sink = bench_xr[1][k->arg];
+	memcpy(bench_xr, bench_xr_src, sizeof(bench_xr));
+}
+
+static void run_ms_stereo(const struct kernel* const k, uint32_t calls)
+{
+	while (calls--)
+		l3_do_ms_stereo(SBLIMIT * SSLIMIT, bench_xr);
+	sink = bench_xr[1][k->arg];
+	// every second pass doubles the values
+	memcpy(bench_xr, bench_xr_src, sizeof(bench_xr));
+}
+
+// antialias, IMDCT, overlap and frequency inversion of a long block granule
+static void run_hybrid(const struct kernel* const k, uint32_t calls)
+{
+	struct ch_info ch = { 0 };
+
+	ch.nonzero_len = SBLIMIT * SSLIMIT;
+	while (calls--)
+		l3_hybrid(&ch, 0, bench_xr[0], hybrid_out[0]);
+	sink = hybrid_out[0][0][k->arg];
+}
+
+static void run_imdct36(const struct kernel* const k, uint32_t calls)
+{
+	float rawout[36];
+	uint32_t i;
+
+	for (i = 0; i < calls; ++i)
+		imdct36(bench_xr[0] + i % SBLIMIT * SSLIMIT, rawout, imdct_window[0]);
+	sink = rawout[k->arg];
+}
+
+static void run_imdct12(const struct kernel* const k, uint32_t calls)
+{
+	float rawout[36] = { 0 };
+	uint32_t i;
+
+	for (i = 0; i < calls; ++i)
+		imdct12(bench_xr[0] + i % SBLIMIT * SSLIMIT, rawout, imdct_window[2]);
+	sink = rawout[k->arg + 6];
+}
+
+static void run_dct32to64(const struct kernel* const k, uint32_t calls)
+{
+	uint32_t i;
+
+	for (i = 0; i < calls; ++i)
+		dct32to64(bench_s[i % SSLIMIT], _V[0]);
+	sink = _V[0][k->arg];
+}
+
+static void run_synthesis(const struct kernel* const k, uint32_t calls)
+{
+	uint32_t i;
+
+	for (i = 0; i < calls; ++i) {
+		if (bench_pcm.write_off[0] == bench_pcm.pcm_buf_size)
+			bench_pcm.write_off[0] = 0;
+		synthesis_subband_filter(bench_s[i % SSLIMIT], 0, 2, &bench_pcm);
+	}
+	sink = bench_pcm_buf[k->arg];
+}
+
+// both channels per call, into interleaved s16
+static void run_synthesis_stereo(const struct kernel* const k, uint32_t calls)
+{
+	uint32_t i;
+
+	// the frame interleaved store needs both channels at the same frame
+	bench_pcm.write_off[0] = bench_pcm.write_off[1] = 0;
+	for (i = 0; i < calls; ++i) {
+		if (bench_pcm.write_off[0] == bench_pcm.pcm_buf_size)
+			bench_pcm.write_off[0] = bench_pcm.write_off[1] = 0;
+		synthesis_subband_filter_stereo(bench_s[i % SSLIMIT], bench_s[(i + 1) % SSLIMIT], &bench_pcm);
+	}
+	sink = bench_pcm_buf[k->arg];
+}
+
+/*
+* The big_values stream of every table through l3_huffman_decode and through check_huffman_pairs in one region:
+* the values must agree and the generic loop must use up exactly the stream's bits.
+* Returns the number of tables that differ.
+*/
+static int check_huffman(void)
+{
+	short ref[SBLIMIT * SSLIMIT];
+	int t, i, failed = 0;
+
+	for (t = 0; t < 32; ++t) {
+		struct ch_info ch = huffman_ch(t);
+		struct bs s = { 0 }, r = { 0 };
+		int part3_len = huff_bits[t], next, escaped = 0, same;
+
+		if (!huff_bits[t])
+			continue;
+		s.byte_ptr = r.byte_ptr = huff_data[t];
+		l3_huffman_decode(&s, &ch, huff_out, &bench_diag);
+		next = check_huffman_pairs(&r, ht + t, ref, 0, SBLIMIT * SSLIMIT, &part3_len);
+
+		same = next == SBLIMIT * SSLIMIT && !part3_len && !memcmp(huff_out, ref, sizeof(ref));
+		for (i = 0; i < SBLIMIT * SSLIMIT; ++i)
+			escaped += ref[i] > 15 || ref[i] < -15;
+		fprintf(stderr, "l3_huffman_decode_%02d  linbits %2u  %3d values above 15  %s\n", t, ht[t].linbits, escaped, same ? "ok" : "DIFFERS");
+		if (!same)
+			++failed;
+	}
+
+	return failed;
+}
+
+static uint32_t make_kernels(struct kernel* const kernels)
+{
+	uint32_t n = 0;
+	int t;
+
+#define ADD_KERNEL(_Name, _Run, _Arg, _Items, _Unit) do { \
+		struct kernel* const k = &kernels[n++]; \
+		sprintf(k->name, "%s", (_Name)); \
+		k->run = (_Run); \
+		k->arg = (_Arg); \
+		k->items_per_call = (_Items); \
+		k->unit = (_Unit); \
+	} while (0)
+
+	ADD_KERNEL("bs_readBit", run_readBit, 0, 1, "Mbit/s");
+	ADD_KERNEL("bs_readBits", run_readBits, 0, widths_mean, "Mbit/s");
+	ADD_KERNEL("l3_decode_sideinfo", run_sideinfo, 0, 256, "Mbit/s");
+	for (t = 0; t < HUFF_TABLES; ++t) {
+		if (!huff_bits[t])
+			continue;
+		ADD_KERNEL("", run_huffman, t, SBLIMIT * SSLIMIT, "Mvalues/s");
+		if (t < 32)
+			sprintf(kernels[n - 1].name, "l3_huffman_decode_%02d", t);
+		else sprintf(kernels[n - 1].name, "l3_huffman_decode_c%d", t - 32);
+	}
+	ADD_KERNEL("l3_requantize", run_requantize, 0, SBLIMIT * SSLIMIT, "Msamples/s");
+	ADD_KERNEL("l3_do_ms_stereo", run_ms_stereo, 0, 2 * SBLIMIT * SSLIMIT, "Msamples/s");
+	ADD_KERNEL("l3_requantize_ms", run_requantize_ms, 0, 2 * SBLIMIT * SSLIMIT, "Msamples/s");
+	ADD_KERNEL("l3_hybrid", run_hybrid, 0, SBLIMIT * SSLIMIT, "Msamples/s");
+	ADD_KERNEL("imdct36", run_imdct36, 0, SSLIMIT, "Msamples/s");
+	ADD_KERNEL("imdct12", run_imdct12, 0, SSLIMIT, "Msamples/s");
+	ADD_KERNEL("dct32to64", run_dct32to64, 0, SBLIMIT, "Msamples/s");
+	ADD_KERNEL("synthesis_subband_filter", run_synthesis, 0, SBLIMIT, "Msamples/s");
+	ADD_KERNEL("synthesis_subband_filter_stereo", run_synthesis_stereo, 0, 2 * SBLIMIT, "Msamples/s");
+
+#undef ADD_KERNEL
+	return n;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+	const double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void measure(struct kernel* const k, const uint32_t runs, double* const batch_ns)
+{
+	uint32_t calls = 1, r;
+	uint64_t ns;
+
+	// calibrate the batch, which also warms the caches
+	for (;;) {
+		const uint64_t start = clock_Nanos();
+		k->run(k, calls);
+		if ((ns = clock_Nanos() - start) >= MIN_BATCH_NS || calls >= 1u << 30)
+			break;
+		calls *= 2;
+	}
+
+	for (r = 0; r < runs; ++r) {
+		const uint64_t start = clock_Nanos();
+		k->run(k, calls);
+		batch_ns[r] = (double)(clock_Nanos() - start) / calls;
+	}
+
+	qsort(batch_ns, runs, sizeof(double), cmp_double);
+	k->ns_per_call = batch_ns[0];
+	k->median_ns = batch_ns[runs / 2];
+}
+
+static void write_json(FILE* const fp, const struct kernel* const kernels, const uint32_t n, const uint32_t runs)
+{
+	uint32_t i;
+
+	fprintf(fp, "{ \"runs\": %u,\n\"kernels\": [\n", runs);
+	for (i = 0; i < n; ++i) {
+		const struct kernel* const k = &kernels[i];
+		fprintf(fp, "{ \"name\": \"%s\", \"ns_per_call\": %.3f, \"median_ns_per_call\": %.3f, \"throughput\": %.2f, \"unit\": \"%s\" }%s\n",
+			k->name, k->ns_per_call, k->median_ns, k->items_per_call * 1e3 / k->ns_per_call, k->unit, i + 1 < n ? "," : "");
+	}
+	fprintf(fp, "] }\n");
+}
+
+static char* read_text(const char* const name)
+{
+	FILE* fp = fopen(name, "rb");
+	char* text = NULL;
+	long len;
+
+	do {
+		if (!fp || fseek(fp, 0, SEEK_END) || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET))
+			break;
+		if (!(text = malloc(len + 1)) || fread(text, 1, len, fp) != (size_t)len)
+			break;
+		text[len] = 0;
+
+		fclose(fp);
+		return text;
+	} while (0);
+
+	if (fp)
+		fclose(fp);
+	free(text);
+	return NULL;
+}
+
+// ns_per_call of the kernel in a file written by --save, < 0 if it has none
+static double baseline_ns(const char* const text, const char* const name)
+{
+	char key[64];
+	const char* p;
+
+	snprintf(key, sizeof(key), "\"name\": \"%.40s\"", name);
+	if (!(p = strstr(text, key)) || !(p = strstr(p, "\"ns_per_call\":")))
+		return -1;
+
+	return strtod(p + 14, NULL);
+}
+
+static int compare_baseline(const struct kernel* const kernels, const uint32_t n, const char* const name, const double tolerance)
+{
+	char* const text = read_text(name);
+	uint32_t i, regressions = 0;
+
+	if (!text) {
+		LOG_E("read_text", "can't read the baseline!");
+		return -1;
+	}
+
+	for (i = 0; i < n; ++i) {
+		const double base = baseline_ns(text, kernels[i].name), change = (kernels[i].ns_per_call / base - 1) * 100;
+		if (base <= 0) {
+			fprintf(stderr, "%-28s no baseline\n", kernels[i].name);
+			continue;
+		}
+		fprintf(stderr, "%-28s %10.3f ns  baseline %10.3f ns  %+6.1f%%%s\n", kernels[i].name, kernels[i].ns_per_call, base, change,
+			change > tolerance ? "  REGRESSION" : "");
+		if (change > tolerance)
+			++regressions;
+	}
+	fprintf(stderr, "%u of %u kernels slower than the baseline by more than %.1f%%\n", regressions, n, tolerance);
+
+	free(text);
+	return regressions ? 1 : 0;
+}
+
+static int selected(const char* const name, char** const filters, const int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		if (strstr(name, filters[i]))
+			return 1;
+	}
+
+	return !count;
+}
+
+int main(int argc, char** argv)
+{
+	static struct kernel kernels[64];
+	const char* save_name = NULL, * baseline_name = NULL;
+	double tolerance = DEFAULT_TOLERANCE, * batch_ns;
+	uint32_t runs = DEFAULT_RUNS, n, m = 0, i;
+	int32_t cpu = -1;
+	int a, check = 0, ret = 0;
+
+	for (a = 1; a < argc && !strncmp(argv[a], "--", 2); ++a) {
+		if (a + 1 < argc && !strcmp(argv[a], "--runs"))
+			runs = (uint32_t)atoi(argv[++a]);
+		else if (a + 1 < argc && !strcmp(argv[a], "--pin"))
+			cpu = atoi(argv[++a]);
+		else if (a + 1 < argc && !strcmp(argv[a], "--save"))
+			save_name = argv[++a];
+		else if (a + 1 < argc && !strcmp(argv[a], "--baseline"))
+			baseline_name = argv[++a];
+		else if (a + 1 < argc && !strcmp(argv[a], "--tolerance"))
+			tolerance = atof(argv[++a]);
+		else if (!strcmp(argv[a], "--check"))
+			check = 1;
+		else break;
+	}
+
+	if (!runs || (a < argc && !strncmp(argv[a], "--", 2))) {
+		fprintf(stderr, "usage: kernel_bench [--runs N] [--pin CPU] [--save out.json] [--baseline in.json [--tolerance PCT]] [name...]\n"
+			"       kernel_bench --check\n");
+		return -1;
+	}
+
+	if (check) {
+		make_input();
+		return check_huffman() ? 1 : 0;
+	}
+
+	if (cpu >= 0 && thread_PinCurrent((uint32_t)cpu) == -1) {
+		LOG_E("thread_PinCurrent", "can't pin to the cpu!");
+		return -1;
+	}
+
+	if (!(batch_ns = malloc(runs * sizeof(double))))
+		return -1;
+
+	make_input();
+	n = make_kernels(kernels);
+	for (i = 0; i < n; ++i) {
+		if (!selected(kernels[i].name, argv + a, argc - a))
+			continue;
+		measure(&kernels[i], runs, batch_ns);
+		kernels[m++] = kernels[i];
+	}
+	free(batch_ns);
+
+	write_json(stdout, kernels, m, runs);
+
+	if (save_name) {
+		FILE* const fp = fopen(save_name, "w");
+		if (!fp) {
+			LOG_E("fopen", "can't write the results!");
+			return -1;
+		}
+		write_json(fp, kernels, m, runs);
+		fclose(fp);
+	}
+
+	if (baseline_name)
+		ret = compare_baseline(kernels, m, baseline_name, tolerance);
+
+	return ret;
+}
@@ -0,0 +1,134 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "accuracy.h"
+#include "decoder.h"
+#include "json.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+struct accuracy_run {
+	const struct decoder_handle* handle;
+	int compare;	// 0: store the reference output, 1: compare with it
+
+	float* ref;
+	size_t ref_len;
+	size_t ref_cap;
+	size_t pos;
+	int failed;		// out of memory or more samples than the reference
+
+	double sum_sq;
+	double max_err;
+};
+
+static void on_pcm(void* arg, const uint8_t* pcm, uint32_t frames)
+{
+	struct accuracy_run* const run = arg;
+	const float* const f = (const float*)pcm;
+	const size_t n = (size_t)frames * run->handle->pcm.channels;
+	size_t i;
+
+	if (run->failed)
+		return;
+
+	if (!run->compare) {
+		if (run->ref_len + n > run->ref_cap) {
+			const size_t cap = (run->ref_len + n) * 2;
+			float* const ref = realloc(run->ref, cap * sizeof(float));
+			if (!ref) {
+				run->failed = 1;
+				return;
+			}
+			run->ref = ref;
+			run->ref_cap = cap;
+		}
+		memcpy(run->ref + run->ref_len, f, n * sizeof(float));
+		run->ref_len += n;
+		return;
+	}
+
+	if (run->pos + n > run->ref_len) {
+		run->failed = 1;
+		return;
+	}
+	for (i = 0; i < n; ++i) {
+		const double err = fabs((double)f[i] - run->ref[run->pos + i]);
+		run->sum_sq += err * err;
+		if (!(err <= run->max_err)) // a NaN sticks
+			run->max_err = err;
+	}
+	run->pos += n;
+}
+
+static uint32_t decode(const char* const name, struct accuracy_run* const run, const enum DECODE_FLAGS flags)
+{
+	struct decoder_handle* handle = decoder_Init(name, OUTPUT_CALLBACK, NULL);
+	uint32_t frames;
+
+	if (!handle)
+		return 0;
+	handle->decode_flags = DECODE_QUIET | flags;
+	handle->sample_format = SAMPLE_F32;
+	handle->channel_mode = CHANNEL_NATIVE;
+	handle->callback = on_pcm;
+	handle->callback_arg = run;
+	run->handle = handle;
+
+	frames = decoder_Run(handle);
+	decoder_Release(&handle);
+
+	return frames;
+}
+
+static const char* compliance(const double rms, const double max_err)
+{
+	if (rms < pow(2.0, -15) / sqrt(12.0) && max_err <= pow(2.0, -14))
+		return "full accuracy";
+	if (rms < pow(2.0, -11) / sqrt(12.0))
+		return "limited accuracy";
+	return "not compliant";
+}
+
+static void accuracy_file(const char* const name)
+{
+	struct accuracy_run run = { 0 };
+	uint32_t frames;
+
+	printf("{ \"file\": ");
+	json_PrintString(name);
+	printf(", ");
+
+	if (!(frames = decode(name, &run, DECODE_REFERENCE)) || run.failed) {
+		printf("\"error\": \"reference decode failed\" }");
+	} else {
+		run.compare = 1;
+		if (decode(name, &run, 0) != frames || run.failed || run.pos != run.ref_len) {
+			printf("\"error\": \"the outputs differ in length\" }");
+		} else {
+			const double rms = run.pos ? sqrt(run.sum_sq / run.pos) : 0;
+			printf("\"frames\": %u, \"samples\": %zu, \"rms_error\": %.3e, \"max_abs_error\": %.3e, \"rms_lsb16\": %.4f, \"max_lsb16\": %.4f, \"compliance\": \"%s\" }",
+				frames, run.pos, rms, run.max_err, rms * 32768, run.max_err * 32768, compliance(rms, run.max_err));
+		}
+	}
+
+	free(run.ref);
+}
+
+int accuracy_Main(int argc, char** argv)
+{
+	int i;
+
+	if (!argc) {
+		fprintf(stderr, "usage: --accuracy file.mp3...\n");
+		return -1;
+	}
+
+	printf("[\n");
+	for (i = 0; i < argc; ++i) {
+		accuracy_file(argv[i]);
+		printf(i + 1 < argc ? ",\n" : "\n");
+	}
+	printf("]\n");
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef _MMP_ACCURACY_H_
+#define _MMP_ACCURACY_H_ 1
+
+/*
+* --accuracy file.mp3...
+* Decode every file with the float path and with the double precision reference (DECODE_REFERENCE),
+* and print the difference as JSON on stdout: RMS and maximum absolute error relative to full scale,
+* and the ISO/IEC 11172-4 class they meet.
+*   full accuracy: RMS < 2^-15 / sqrt(12) and maximum <= 2^-14
+*   limited accuracy: RMS < 2^-11 / sqrt(12)
+* Both decodes output 32 bit float, the reference is rounded to it once.
+*/
+int accuracy_Main(int argc, char** argv);
+
+#endif // !_MMP_ACCURACY_H_
@@ -1,51 +1,121 @@
 #include "audio.h"
+
+#ifdef _WIN32
+
+#include "ring.h"
+#include "thread.h"
 #include <stdio.h>
+#include <string.h>
 #include <Windows.h>
+#include <mmreg.h>
 
 #pragma comment(lib, "Winmm.lib")
 
-static CRITICAL_SECTION g_cs;
-static HWAVEOUT g_WaveDev;
-static uint32_t g_nBlocks;
+// KSDATAFORMAT_SUBTYPE_*, without pulling in ksmedia.h and its GUID linkage
+static const GUID _KSDATAFORMAT_SUBTYPE_PCM = { 0x00000001, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+static const GUID _KSDATAFORMAT_SUBTYPE_IEEE_FLOAT = { 0x00000003, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+
+#define AUDIO_MAX_PERIODS	32
 
-static void CALLBACK waveout_callback(HWAVEOUT hwo, UINT uMsg, DWORD_PTR dwInstance, DWORD_PTR dwParam1, DWORD_PTR dwParam2)
+static HWAVEOUT g_WaveDev;
+static struct pcm_ring* g_ring;
+static WAVEHDR g_hdrs[AUDIO_MAX_PERIODS];
+static uint32_t g_nPeriods;
+static uint32_t g_nWrite;
+static volatile uint32_t g_nSubmitted;	// headers waveOutWrite accepted, their WHDR_DONE is valid
+static volatile uint32_t g_stop;
+static int g_failed;
+static HANDLE g_done;	// auto-reset, set by the device (CALLBACK_EVENT) on every completed block
+static mmp_thread g_thread;
+
+/*
+* The consumer side of the ring. A waveOutProc may call little more than SetEvent, and ring_endRead can take the
+* ring lock, so the device only signals g_done and this thread retires the blocks: they complete in submission
+* order, every one with WHDR_DONE frees the oldest period.
+*/
+static int waveout_done(void* arg)
 {
-	if (uMsg == WOM_DONE) {
-		LPWAVEHDR wh = (LPWAVEHDR)dwParam1;
-		waveOutUnprepareHeader(hwo, wh, sizeof(WAVEHDR));
-		HGDIOBJ hg = GlobalHandle(wh->lpData);
-		if (hg && GlobalUnlock(hg))
-			GlobalFree(hg);
-		hg = GlobalHandle(wh);
-		if (hg && GlobalUnlock(hg))
-			GlobalFree(hg);
-		EnterCriticalSection(&g_cs);
-		--g_nBlocks;
-		LeaveCriticalSection(&g_cs);
+	uint32_t done = 0;
+
+	for (;;) {
+		WaitForSingleObject(g_done, INFINITE);
+		while (done != atomic_Load(&g_nSubmitted) && g_hdrs[done & (g_nPeriods - 1)].dwFlags & WHDR_DONE) {
+			++done;
+			ring_endRead(g_ring);
+		}
+		if (atomic_Load(&g_stop))
+			break;
 	}
+
+	(void)arg;
+	return 0;
 }
 
-int audio_open(uint32_t rate)
+int audio_open(uint32_t rate, uint16_t channels, enum SAMPLE_FORMAT format, uint32_t period_size, uint32_t periods)
 {
-	if (!waveOutGetNumDevs()) {
+	if (!waveOutGetNumDevs() || periods > AUDIO_MAX_PERIODS) {
 		return -1;
 	}
 
-	WAVEFORMATEX wfx;
+	WAVEFORMATEXTENSIBLE wfx;
+	const WORD bits = format == SAMPLE_S16 ? 16 : 32;
+
+	memset(&wfx, 0, sizeof(wfx));
+	wfx.Format.wFormatTag = WAVE_FORMAT_PCM;
+	wfx.Format.wBitsPerSample = bits;
+	wfx.Format.nChannels = channels;
+	wfx.Format.nSamplesPerSec = rate;
+	wfx.Format.nBlockAlign = wfx.Format.nChannels * bits / 8;
+	wfx.Format.nAvgBytesPerSec = wfx.Format.nSamplesPerSec * wfx.Format.nBlockAlign;
+	if (format != SAMPLE_S16) {
+		// 24 valid bits in a 32-bit container and float need the extensible header
+		wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+		wfx.Format.cbSize = sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX);
+		wfx.Samples.wValidBitsPerSample = format == SAMPLE_S24_32 ? 24 : 32;
+		wfx.dwChannelMask = channels == 1 ? SPEAKER_FRONT_CENTER : SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+		wfx.SubFormat = format == SAMPLE_F32 ? _KSDATAFORMAT_SUBTYPE_IEEE_FLOAT : _KSDATAFORMAT_SUBTYPE_PCM;
+	}
+
+	if (!(g_ring = ring_Init(periods, period_size, periods / 2, periods))) {
+		return -1;
+	}
+	g_nPeriods = ring_Periods(g_ring);
 
-	wfx.wFormatTag = WAVE_FORMAT_PCM;
-	wfx.wBitsPerSample = 16;
-	wfx.nChannels = 2;
-	wfx.nSamplesPerSec = rate;
-	wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * 4;
-	wfx.nBlockAlign = 4;
+	if (!(g_done = CreateEvent(NULL, FALSE, FALSE, NULL))) {
+		ring_Release(&g_ring);
+		return -1;
+	}
 
-	if (waveOutOpen(&g_WaveDev, WAVE_MAPPER, &wfx, (DWORD_PTR)waveout_callback, 0, CALLBACK_FUNCTION) != MMSYSERR_NOERROR) {
+	if (waveOutOpen(&g_WaveDev, WAVE_MAPPER, &wfx.Format, (DWORD_PTR)g_done, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR) {
+		g_WaveDev = NULL;
+		CloseHandle(g_done);
+		ring_Release(&g_ring);
 		return -1;
 	}
 
 	waveOutReset(g_WaveDev);
-	InitializeCriticalSection(&g_cs);
+
+	g_nWrite = 0;
+	g_nSubmitted = 0;
+	g_stop = 0;
+	g_failed = 0;
+	if (thread_Create(&g_thread, waveout_done, NULL) == -1) {
+		waveOutClose(g_WaveDev);
+		g_WaveDev = NULL;
+		CloseHandle(g_done);
+		ring_Release(&g_ring);
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < g_nPeriods; ++i) {
+		memset(&g_hdrs[i], 0, sizeof(WAVEHDR));
+		g_hdrs[i].lpData = (LPSTR)ring_Slot(g_ring, i);
+		g_hdrs[i].dwBufferLength = period_size;
+		if (waveOutPrepareHeader(g_WaveDev, &g_hdrs[i], sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
+			audio_close();
+			return -1;
+		}
+	}
 
 	return 0;
 }
@@ -53,65 +123,68 @@ int audio_open(uint32_t rate)
 void audio_close(void)
 {
 	if (g_WaveDev) {
-		while (g_nBlocks)
-			Sleep(76);
+		if (!g_failed)
+			ring_Drain(g_ring);
+		atomic_Store(&g_stop, 1);
+		SetEvent(g_done);
+		thread_Join(g_thread);
 
 		waveOutReset(g_WaveDev);
+		for (uint32_t i = 0; i < g_nPeriods; ++i) {
+			if (g_hdrs[i].dwFlags & WHDR_PREPARED)
+				waveOutUnprepareHeader(g_WaveDev, &g_hdrs[i], sizeof(WAVEHDR));
+		}
 		waveOutClose(g_WaveDev);
 		g_WaveDev = NULL;
-		DeleteCriticalSection(&g_cs);
+		CloseHandle(g_done);
+		ring_Release(&g_ring);
 	}
 }
 
 int play_samples(const void* data, uint32_t len)
 {
-	while (g_nBlocks >> 4)
-		Sleep(76);
-
-	HGDIOBJ hg_Data = GlobalAlloc(GMEM_MOVEABLE, len);
-	if (!hg_Data) {
-		return -1;
-	}
-	void* pData = GlobalLock(hg_Data);
-	if (!pData) {
-		GlobalFree(hg_Data);
+	if (g_failed || len > ring_periodSize(g_ring))
 		return -1;
-	}
-	CopyMemory(pData, data, len);
 
-	HGDIOBJ hg_Hdr = GlobalAlloc(GMEM_MOVEABLE | GMEM_ZEROINIT, sizeof(WAVEHDR));
-	if (!hg_Hdr) {
-		GlobalUnlock(hg_Data);
-		GlobalFree(hg_Data);
-		return -1;
-	}
-	LPWAVEHDR wh = GlobalLock(hg_Hdr);
-	if (!wh) {
-		GlobalUnlock(hg_Data);
-		GlobalFree(hg_Data);
-		GlobalFree(hg_Hdr);
+	uint8_t* const period = ring_beginWrite(g_ring);
+	LPWAVEHDR wh = &g_hdrs[g_nWrite++ & (g_nPeriods - 1)];
+
+	memcpy(period, data, len);
+	wh->dwBufferLength = len;
+	ring_endWrite(g_ring, len);
+
+	if (waveOutWrite(g_WaveDev, wh, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
+		// the period never completes, stop feeding the device
+		g_failed = 1;
 		return -1;
 	}
-	wh->dwBufferLength = len;
-	wh->lpData = pData;
+	atomic_Store(&g_nSubmitted, g_nWrite);
 
-	do {
-		if (waveOutPrepareHeader(g_WaveDev, wh, sizeof(WAVEHDR)) != MMSYSERR_NOERROR)
-			break;
-		if (waveOutWrite(g_WaveDev, wh, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
-			waveOutUnprepareHeader(g_WaveDev, wh, sizeof(WAVEHDR));
-			break;
-		}
-		EnterCriticalSection(&g_cs);
-		++g_nBlocks;
-		LeaveCriticalSection(&g_cs);
-		return 0;
-	} while (0);
+	return 0;
+}
 
-	GlobalUnlock(hg_Data);
-	GlobalFree(hg_Data);
-	GlobalUnlock(hg_Hdr);
-	GlobalFree(hg_Hdr);
+#else
 
+// no device backend here, use OUTPUT_PACED instead
+int audio_open(uint32_t rate, uint16_t channels, enum SAMPLE_FORMAT format, uint32_t period_size, uint32_t periods)
+{
+	(void)rate;
+	(void)channels;
+	(void)format;
+	(void)period_size;
+	(void)periods;
 	return -1;
 }
+
+void audio_close(void)
+{
+}
+
+int play_samples(const void* data, uint32_t len)
+{
+	(void)data;
+	(void)len;
+	return -1;
+}
+
+#endif // _WIN32
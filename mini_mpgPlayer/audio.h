@@ -3,16 +3,25 @@
 
 #include <stdint.h>
 
+// s24_32: 24 bits MSB aligned in an int32, the low byte 0, as WAVEFORMATEXTENSIBLE with 24 valid bits
+// expects it (the device, the WAV file and the callback get the same layout); f32: [-1.0, 1.0), not clipped
+enum SAMPLE_FORMAT { SAMPLE_S16, SAMPLE_S24_32, SAMPLE_S32, SAMPLE_F32 };
+
 struct pcm_stream {
 	uint8_t* pcm_buf;
 	uint32_t read_off;
-	uint32_t write_off[2]; // {0 2}
+	uint32_t write_off[2];	// next frame (interleaved) or sample (planar) of each channel
+
+	uint32_t audio_buf_size;	// bytes of one channel plane (planar) or of the period, where write_off[0] ends
+	uint32_t pcm_buf_size;	// bytes of one period
 
-	uint32_t audio_buf_size;	// pcm_size * 4 ݴﵽֵһδ
-	uint32_t pcm_buf_size;	// audio_buf_size * 4ݴﵽֵиλ
+	enum SAMPLE_FORMAT format;
+	uint8_t channels;
+	uint8_t sample_size;
+	uint8_t planar;	// one plane per channel instead of interleaved frames
 };
 
-int audio_open(uint32_t rate);
+int audio_open(uint32_t rate, uint16_t channels, enum SAMPLE_FORMAT format, uint32_t period_size, uint32_t periods);
 void audio_close(void);
 int play_samples(const void* data, uint32_t len);
 
@@ -0,0 +1,160 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "bench.h"
+#include "decoder.h"
+#include "json.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_RUNS	5
+#define DEFAULT_WARMUP	1
+
+struct bench_options {
+	uint32_t runs;
+	uint32_t warmup;
+	int32_t cpu;	// -1: not pinned
+	int preload;
+};
+
+static int cmp_u64(const void* a, const void* b)
+{
+	const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// the size of the file, and with preload its content
+static int read_file(const char* const name, const int preload, uint8_t** const data, uint32_t* const size)
+{
+	FILE* fp = fopen(name, "rb");
+	long len;
+
+	*data = NULL;
+	do {
+		if (!fp || fseek(fp, 0, SEEK_END) || (len = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET))
+			break;
+		*size = (uint32_t)len;
+		if (preload && (!(*data = malloc(*size)) || fread(*data, 1, *size, fp) != *size))
+			break;
+
+		fclose(fp);
+		return 0;
+	} while (0);
+
+	if (fp)
+		fclose(fp);
+	free(*data);
+	*data = NULL;
+	return -1;
+}
+
+static void print_error(const char* const name, const char* const msg)
+{
+	printf("{ \"file\": ");
+	json_PrintString(name);
+	printf(", \"error\": \"%s\" }", msg);
+}
+
+/*
+* Only decoder_Run is timed. The frame times of all measured runs are pooled in one histogram,
+* the rates use the median run.
+*/
+static void bench_file(const char* const name, const struct bench_options* const opt)
+{
+	static struct latency_hist hist;
+	uint8_t* data;
+	uint32_t size, frames = 0, rate = 0, channels = 0, r;
+	uint64_t* run_ns;
+
+	if (read_file(name, opt->preload, &data, &size) == -1) {
+		print_error(name, "can't read the file");
+		return;
+	}
+
+	if (!(run_ns = malloc(opt->runs * sizeof(uint64_t)))) {
+		print_error(name, "out of memory");
+		free(data);
+		return;
+	}
+	hist_Reset(&hist);
+
+	for (r = 0; r < opt->warmup + opt->runs; ++r) {
+		struct decoder_handle* handle = data ? decoder_InitMemory(data, size, 0, NULL) : decoder_Init(name, 0, NULL);
+		uint64_t start;
+
+		if (!handle)
+			break;
+		handle->decode_flags = DECODE_QUIET;
+		handle->diag.sink = NULL;
+		if (r >= opt->warmup)
+			handle->frame_hist = &hist;
+
+		start = clock_Nanos();
+		frames = decoder_Run(handle);
+		if (r >= opt->warmup)
+			run_ns[r - opt->warmup] = clock_Nanos() - start;
+		rate = handle->cur_frame.samplingrate;
+		channels = handle->cur_frame.nch;
+		decoder_Release(&handle);
+
+		if (!frames)
+			break;
+	}
+
+	if (r < opt->warmup + opt->runs || !hist.total) {
+		print_error(name, "decode failed");
+	} else {
+		const double audio_secs = frames * 1152.0 / rate;
+
+		qsort(run_ns, opt->runs, sizeof(uint64_t), cmp_u64);
+		const double median_secs = run_ns[opt->runs / 2] / 1e9;
+		printf("{ \"file\": ");
+		json_PrintString(name);
+		printf(", \"sample_rate\": %u, \"channels\": %u, \"frames\": %u, \"audio_seconds\": %.3f,\n", rate, channels, frames, audio_secs);
+		printf("\t\"decode_seconds\": { \"min\": %.6f, \"median\": %.6f, \"max\": %.6f },\n", run_ns[0] / 1e9, median_secs, run_ns[opt->runs - 1] / 1e9);
+		printf("\t\"frames_per_second\": %.1f, \"realtime_factor\": %.2f,\n", frames / median_secs, audio_secs / median_secs);
+		printf("\t\"ns_per_frame\": { \"min\": %llu, \"mean\": %.0f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu } }",
+			(unsigned long long)hist.min, hist_Mean(&hist), (unsigned long long)hist_Percentile(&hist, 50), (unsigned long long)hist_Percentile(&hist, 90),
+			(unsigned long long)hist_Percentile(&hist, 99), (unsigned long long)hist_Percentile(&hist, 99.9), (unsigned long long)hist.max);
+	}
+
+	free(run_ns);
+	free(data);
+}
+
+int bench_Main(int argc, char** argv)
+{
+	struct bench_options opt = { DEFAULT_RUNS, DEFAULT_WARMUP, -1, 0 };
+	int i;
+
+	for (i = 0; i < argc && !strncmp(argv[i], "--", 2); ++i) {
+		if (!strcmp(argv[i], "--preload"))
+			opt.preload = 1;
+		else if (i + 1 < argc && !strcmp(argv[i], "--runs"))
+			opt.runs = (uint32_t)atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "--warmup"))
+			opt.warmup = (uint32_t)atoi(argv[++i]);
+		else if (i + 1 < argc && !strcmp(argv[i], "--pin"))
+			opt.cpu = atoi(argv[++i]);
+		else break;
+	}
+
+	if (i == argc || !opt.runs || !strncmp(argv[i], "--", 2)) {
+		fprintf(stderr, "usage: --bench [--runs N] [--warmup N] [--pin CPU] [--preload] file.mp3...\n");
+		return -1;
+	}
+
+	if (opt.cpu >= 0 && thread_PinCurrent((uint32_t)opt.cpu) == -1) {
+		LOG_E("thread_PinCurrent", "can't pin to the cpu!");
+		return -1;
+	}
+
+	printf("{ \"runs\": %u, \"warmup\": %u, \"cpu\": %d, \"preload\": %s,\n\"files\": [\n", opt.runs, opt.warmup, opt.cpu, opt.preload ? "true" : "false");
+	for (; i < argc; ++i) {
+		bench_file(argv[i], &opt);
+		printf(i + 1 < argc ? ",\n" : "\n");
+	}
+	printf("] }\n");
+
+	return 0;
+}
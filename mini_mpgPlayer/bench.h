@@ -0,0 +1,11 @@
+#ifndef _MMP_BENCH_H_
+#define _MMP_BENCH_H_ 1
+
+/*
+* --bench [--runs N] [--warmup N] [--pin CPU] [--preload] file.mp3...
+* Decode every file without an output, warmup + runs times, and print the results as JSON on stdout.
+* --pin: run on one logical processor, --preload: decode from memory to leave the file I/O out.
+*/
+int bench_Main(int argc, char** argv);
+
+#endif // !_MMP_BENCH_H_
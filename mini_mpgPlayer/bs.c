@@ -30,6 +30,18 @@ struct bs* bs_Init(uint32_t size, const char* const file_name)
 	return NULL;
 }
 
+struct bs* bs_InitMemory(uint32_t size, const void* const data, uint32_t len)
+{
+	struct bs* s = bs_Init(size, NULL);
+
+	if (s) {
+		s->src_buf = data;
+		s->src_len = len;
+	}
+
+	return s;
+}
+
 void bs_Release(struct bs** bstream)
 {
 	if (bstream && *bstream) {
@@ -118,13 +130,41 @@ uint32_t bs_Append(struct bs* bstream, const void* src, int32_t off, uint32_t le
 uint32_t bs_Prefect(struct bs* bstream, uint32_t len)
 {
 	if (len == bs_Append(bstream, NULL, 0, len)) {
-		len = fread(bstream->end_ptr, 1, len, bstream->file_ptr);
+		PROFILE_BEGIN(start);
+		if (bstream->file_ptr) {
+			len = fread(bstream->end_ptr, 1, len, bstream->file_ptr);
+		} else {
+			if (len > bstream->src_len - bstream->src_pos)
+				len = bstream->src_len - bstream->src_pos;
+			memcpy(bstream->end_ptr, bstream->src_buf + bstream->src_pos, len);
+			bstream->src_pos += len;
+		}
+		PROFILE_END(bstream->prof, PROFILE_IO, start);
 		bstream->end_ptr += len;
 	}
 
 	return len;
 }
 
+int bs_Seek(struct bs* bstream, int32_t off, int whence)
+{
+	int64_t pos = off;
+
+	bstream->synced = 0;
+	if (bstream->file_ptr)
+		return fseek(bstream->file_ptr, off, whence) ? -1 : 0;
+
+	if (whence == SEEK_CUR)
+		pos += bstream->src_pos;
+	else if (whence == SEEK_END)
+		pos += bstream->src_len;
+	if (pos < 0 || pos > bstream->src_len)
+		return -1;
+	bstream->src_pos = (uint32_t)pos;
+
+	return 0;
+}
+
 uint32_t bs_skipBytes(struct bs* bstream, uint32_t nBytes)
 {
 	if (nBytes > bs_Avaliable(bstream) + bs_freeSpace(bstream))
@@ -222,6 +262,23 @@ uint32_t bs_readBits(struct bs* bstream, uint32_t nBits)
 	return bits;
 }
 
+uint64_t bs_peekBits64(const struct bs* bstream)
+{
+	const uint8_t* const p = bstream->byte_ptr;
+	uint64_t bits;
+
+	memcpy(&bits, p, 8);
+#ifdef _MSC_VER
+	bits = _byteswap_uint64(bits);
+#else
+	bits = __builtin_bswap64(bits);
+#endif
+	if (bstream->bit_pos)
+		bits = bits << bstream->bit_pos | p[8] >> (8 - bstream->bit_pos);
+
+	return bits;
+}
+
 uint32_t bs_readByte(struct bs* bstream)
 {
 	unsigned byte = *bstream->byte_ptr++;
@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include "profile.h"
 
 struct bs {
 	FILE* file_ptr;
@@ -12,9 +13,22 @@ struct bs {
 	uint8_t* byte_ptr;
 	uint8_t* end_ptr;
 	const uint8_t* max_ptr;
+
+	// a memory source read instead of file_ptr (bs_InitMemory)
+	const uint8_t* src_buf;
+	uint32_t src_len;
+	uint32_t src_pos;
+
+	// MMP_PROFILE: the reads from the source are counted as PROFILE_IO when set
+	struct decoder_profile* prof;
+
+	// decode_next_frame: the last frame was found in place, the next header needs no confirmation; bs_Seek clears it
+	uint8_t synced;
 };
 
 struct bs* bs_Init(uint32_t size, const char* const file_name);
+// the data is not copied and has to outlive the stream
+struct bs* bs_InitMemory(uint32_t size, const void* const data, uint32_t len);
 void bs_Release(struct bs** bstream);
 
 uint32_t bs_Avaliable(const struct bs* bstream);
@@ -25,6 +39,8 @@ uint32_t bs_getBitpos(const struct bs* bstream);
 
 uint32_t bs_Append(struct bs* bstream, const void* src, int32_t off, uint32_t len);
 uint32_t bs_Prefect(struct bs* bstream, uint32_t len);
+// fseek() on the source, the buffered bytes are kept
+int bs_Seek(struct bs* bstream, int32_t off, int whence);
 
 uint32_t bs_skipBytes(struct bs* bstream, uint32_t nBytes);
 uint32_t bs_skipBits(struct bs* bstream, uint32_t nBits);
@@ -33,6 +49,8 @@ uint32_t bs_backBits(struct bs* bstream, uint32_t nBits);
 uint8_t bs_readBit(struct bs* bstream);
 // 2 <= nBits <= 17
 uint32_t bs_readBits(struct bs* bstream, uint32_t nBits);
+// the next 64 bits MSB first without consuming them, 9 bytes from byte_ptr are read
+uint64_t bs_peekBits64(const struct bs* bstream);
 uint32_t bs_readByte(struct bs* bstream);
 uint32_t bs_readBytes(struct bs* bstream, void* out, uint32_t nBytes);
 
@@ -3,30 +3,47 @@
 #include "decoder.h"
 #include "layer3.h"
 #include "audio.h"
+#include "paced.h"
 #include "tag.h"
+#include "thread.h"
 #include <stdlib.h>
+#include <string.h>
 
-struct decoder_handle* decoder_Init(const char* const mp3_file_name, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name)
+#define DEFAULT_PERIOD_GRANULES	16
+#define DEFAULT_PERIOD_COUNT	8
+
+static struct decoder_handle* decoder_create(const char* const mp3_file_name, const void* const mp3_data, const uint32_t mp3_size, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name)
 {
 	struct decoder_handle* handle = NULL;
 
 	do {
-		if (!mp3_file_name)
+		if (!mp3_file_name && !mp3_data)
 			break;
 		if (!(handle = calloc(1, sizeof(struct decoder_handle))))
 			break;
 
-		handle->file_stream = bs_Init(2048, mp3_file_name);
+		init_frame_tabs();
+
+		handle->file_stream = mp3_data ? bs_InitMemory(2048, mp3_data, mp3_size) : bs_Init(2048, mp3_file_name);
 		handle->sideinfo_stream = bs_Init(0, NULL);
 		handle->maindata_stream = bs_Init(2048, NULL);
 		if (!handle->file_stream || !handle->sideinfo_stream || !handle->maindata_stream)
 			break;
+		handle->file_stream->prof = &handle->profile;
+		handle->diag.sink = diag_logSink;
+		handle->diag.sink_arg = stderr;
 
 		if (output_flags & OUTPUT_AUDIO)
 			handle->output_flags |= OUTPUT_AUDIO;
+		if (output_flags & OUTPUT_PACED)
+			handle->output_flags |= OUTPUT_PACED;
+		if (output_flags & OUTPUT_CALLBACK)
+			handle->output_flags |= OUTPUT_CALLBACK;
 		if (wav_file_name && output_flags & OUTPUT_FILE) {
 			handle->output_flags |= OUTPUT_FILE;
-			if (!(handle->wav_ptr = fopen(wav_file_name, "wb")))
+			if (output_flags & OUTPUT_RAW)
+				handle->output_flags |= OUTPUT_RAW;
+			if (!(handle->wav = wav_Open(wav_file_name, output_flags & OUTPUT_RAW)))
 				break;
 		}
 
@@ -37,23 +54,77 @@ struct decoder_handle* decoder_Init(const char* const mp3_file_name, const enum
 	return NULL;
 }
 
+struct decoder_handle* decoder_Init(const char* const mp3_file_name, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name)
+{
+	return decoder_create(mp3_file_name, NULL, 0, output_flags, wav_file_name);
+}
+
+struct decoder_handle* decoder_InitMemory(const void* const mp3_data, const uint32_t mp3_size, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name)
+{
+	return decoder_create(NULL, mp3_data, mp3_size, output_flags, wav_file_name);
+}
+
+#ifdef MMP_PROFILE
+static void print_profile(const struct decoder_profile* const prof)
+{
+	const double ns_per_tick = prof->run_ticks ? (double)prof->run_ns / prof->run_ticks : 0;
+	int i;
+
+	fprintf(stderr, "\n%-12s %10s %10s %6s %12s\n", "stage", "calls", "ms", "%", "ticks/call");
+	for (i = 0; i < PROFILE_STAGES; ++i) {
+		const struct profile_counter* const c = &prof->stage[i];
+		fprintf(stderr, "%-12s %10llu %10.2f %6.2f %12.0f\n", profile_stageName(i), (unsigned long long)c->calls, c->ticks * ns_per_tick / 1e6,
+			prof->run_ticks ? c->ticks * 100.0 / prof->run_ticks : 0, c->calls ? (double)c->ticks / c->calls : 0);
+	}
+	fprintf(stderr, "%-12s %10s %10.2f\n", "run", "", prof->run_ns / 1e6);
+}
+#endif
+
 void decoder_Release(struct decoder_handle** const handle)
 {
 	if (handle && *handle) {
+#ifdef MMP_PROFILE
+		if ((*handle)->decode_flags & DECODE_PROFILE_SUMMARY)
+			print_profile(&(*handle)->profile);
+#endif
 		if ((*handle)->output_flags & OUTPUT_AUDIO)
 			audio_close();
-		if ((*handle)->output_flags & OUTPUT_FILE && (*handle)->wav_ptr)
-			fclose((*handle)->wav_ptr);
+		if ((*handle)->output_flags & OUTPUT_PACED)
+			paced_close();
+		if ((*handle)->output_flags & OUTPUT_FILE && wav_Close(&(*handle)->wav) == -1)
+			LOG_E("wav_Close", "write the output file failed!");
 		if ((*handle)->sideinfo_stream)
 			(*handle)->sideinfo_stream->bit_buf = NULL;
 		bs_Release(&(*handle)->file_stream);
 		bs_Release(&(*handle)->sideinfo_stream);
 		bs_Release(&(*handle)->maindata_stream);
+		profile_Release(&(*handle)->profile);
+		free((*handle)->pcm.pcm_buf);
 		free(*handle);
 		*handle = NULL;
 	}
 }
 
+static void rewind_pcm(struct pcm_stream* const pcm_out)
+{
+	pcm_out->write_off[0] = 0;
+	pcm_out->write_off[1] = pcm_out->planar ? pcm_out->audio_buf_size : 0;
+}
+
+// the sync is counted to the frame it finds
+static int next_frame(struct decoder_handle* const handle)
+{
+	++handle->profile.frame;
+	++handle->diag.frame;
+	PROFILE_BEGIN(start);
+	const int ret = decode_next_frame(&handle->cur_frame, handle->file_stream);
+	PROFILE_END(&handle->profile, PROFILE_SYNC, start);
+	if (handle->cur_frame.skipped)
+		diag_Raise(&handle->diag, ret == -1 ? DIAG_SYNC_LOST : DIAG_RESYNC);
+
+	return ret;
+}
+
 static const char* const version_str[] = { "2.5", "Reserved", "2.0", "1.0" };
 static const char* const layer_str[] = { "Reserved", "III", "II", "I" };
 static const char* const mode_str[] = { "Stereo", "Joint-Stereo", "Dual-Channel", "Mono" };
@@ -76,18 +147,22 @@ uint32_t decoder_Run(struct decoder_handle* const handle)
 	struct mpeg_frame* const cur_frame = &handle->cur_frame;
 	struct pcm_stream* const pcm_out = &handle->pcm;
 	uint32_t frame_count = 0;
-	int stat;
+	const int verbose = !(handle->decode_flags & DECODE_QUIET);
 	char log_msg_buf[64];
+#ifdef MMP_PROFILE
+	const uint64_t run_ticks = __rdtsc(), run_ns = clock_Nanos();
+#endif
 
-	decode_id3v1(handle->file_stream);
+	if (verbose)
+		decode_id3v1(handle->file_stream);
 
 	uint32_t id3v2_size;
-	while (decode_id3v2(handle->file_stream, &id3v2_size) == 0) {
-		fseek(handle->file_stream->file_ptr, id3v2_size, SEEK_CUR);
+	while (decode_id3v2(handle->file_stream, &id3v2_size, verbose) == 0) {
+		bs_Seek(handle->file_stream, id3v2_size, SEEK_CUR);
 		handle->file_stream->end_ptr = handle->file_stream->bit_buf;
 	}
 
-	if (decode_next_frame(cur_frame, handle->file_stream) == -1) {
+	if (next_frame(handle) == -1) {
 		LOG_E("decode_next_frame", "can't find the first frame!");
 		return 0;
 	}
@@ -105,62 +180,129 @@ uint32_t decoder_Run(struct decoder_handle* const handle)
 
 	l3_init(&cur_frame->header);
 
-	if (handle->output_flags & OUTPUT_AUDIO) {
-		if (audio_open(cur_frame->samplingrate) == -1) {
-			LOG_E("audio_open", "init the audio output device failed!");
-			return 0;
-		}
+	if (handle->sample_format > SAMPLE_F32 || handle->channel_mode > CHANNEL_RIGHT || handle->rate_shift > 2 || (handle->planar && handle->output_flags & (OUTPUT_AUDIO | OUTPUT_FILE | OUTPUT_PACED))
+		|| (handle->output_flags & OUTPUT_CALLBACK && !handle->callback)
+		|| (handle->decode_flags & DECODE_REFERENCE && (handle->rate_shift || handle->channel_mode == CHANNEL_DOWNMIX))) {
+		LOG_E("check_format", "unsupported output format for the selected outputs!");
+		return 0;
 	}
 
-	if (handle->output_flags & OUTPUT_FILE) {
-		// fwrite("RIFF\xff\xff\xff\xffWAVEfmt \x0a\x0\x0\x0\x1\x0\x2\x0\x44\xac\x0\x0\xa\xb1\x2\x0\x4\x0\xa\0data\xff\xff\xff\xd0", 1, 55, handle->wav_ptr);
-	}
+	pcm_out->format = handle->sample_format;
+	pcm_out->channels = handle->channel_mode == CHANNEL_NATIVE ? cur_frame->nch : handle->channel_mode == CHANNEL_STEREO ? 2 : 1;
+	pcm_out->sample_size = pcm_out->format == SAMPLE_S16 ? 2 : 4;
+	pcm_out->planar = pcm_out->channels == 2 && handle->planar;
+	// the synthesis writes whole granules, so a period is a multiple of them
+	const uint32_t granule_samples = 576 >> handle->rate_shift, rate = cur_frame->samplingrate >> handle->rate_shift;
+	pcm_out->pcm_buf_size = (handle->period_samples ? (handle->period_samples + granule_samples - 1) / granule_samples : DEFAULT_PERIOD_GRANULES) * granule_samples * pcm_out->channels * pcm_out->sample_size;
+	pcm_out->audio_buf_size = pcm_out->planar ? pcm_out->pcm_buf_size / 2 : pcm_out->pcm_buf_size;
 
-	pcm_out->write_off[0] = 0;
-	pcm_out->write_off[1] = 2;
-	// pcm_out->audio_buf_size = cur_frame->pcm_size * 4;
-	// pcm_out->pcm_buf_size = pcm_out->audio_buf_size * 4;
-	pcm_out->pcm_buf_size = cur_frame->pcm_size * 8;
+	if (handle->output_flags & OUTPUT_FILE)
+		wav_setFormat(handle->wav, rate, pcm_out->channels, pcm_out->format);
+	rewind_pcm(pcm_out);
 	if (!(pcm_out->pcm_buf = calloc(1, pcm_out->pcm_buf_size))) {
 		LOG_E("malloc(pcm_buf)", "init the pcm_stream failed!");
 		return 0;
 	}
 
-	if (get_vbr_tag(handle->file_stream, cur_frame) == 0) {
+	const uint32_t period_count = !handle->period_count ? DEFAULT_PERIOD_COUNT : handle->period_count < 2 ? 2 : handle->period_count;
+	if (handle->output_flags & OUTPUT_AUDIO) {
+		if (audio_open(rate, pcm_out->channels, pcm_out->format, pcm_out->pcm_buf_size, period_count) == -1) {
+			LOG_E("audio_open", "init the audio output device failed!");
+			return 0;
+		}
+	}
+
+	if (handle->output_flags & OUTPUT_PACED) {
+		if (paced_open(rate, pcm_out->channels * pcm_out->sample_size, pcm_out->pcm_buf_size, period_count, handle->output_flags & OUTPUT_FILE ? handle->wav : NULL) == -1) {
+			LOG_E("paced_open", "init the paced output failed!");
+			return 0;
+		}
+	}
+
+	if (get_vbr_tag(handle->file_stream, cur_frame, verbose) == 0) {
 		bs_skipBytes(handle->file_stream, cur_frame->sideinfo_size + cur_frame->maindata_size);
-		print_header_info(cur_frame);
-		if (decode_next_frame(cur_frame, handle->file_stream) == -1) {
+		if (verbose)
+			print_header_info(cur_frame);
+		if (next_frame(handle) == -1) {
 			LOG_E("decode_next_frame", "can't find the first frame!");
 			return 0;
 		}
 		++frame_count;
 	}
 
-	print_header_info(cur_frame);
+	if (verbose)
+		print_header_info(cur_frame);
 
 	do {
+		const int timed = handle->frame_times || handle->frame_hist;
+		const uint64_t start = timed ? clock_Nanos() : 0;
+		PROFILE_BEGIN(frame_start);
+
 		++frame_count;
+		handle->profile.frame = frame_count;
+		handle->diag.frame = frame_count;
 
-		if ((stat = l3_decode_samples(handle, frame_count)) == -1)
+		if (handle->decode_flags & DECODE_CRC_CHECK && check_crc16(cur_frame, handle->file_stream->byte_ptr) == -1) {
+			++handle->crc_error_count;
+			l3_skip_samples(handle);
+		} else if (l3_decode_samples(handle) == -1)
 			break;
 
 		bs_skipBytes(handle->file_stream, cur_frame->sideinfo_size + cur_frame->maindata_size);
-		if (stat == 1)
-			continue;
-
-		if (pcm_out->write_off[0] == pcm_out->pcm_buf_size) {
-			if (handle->output_flags & OUTPUT_AUDIO && -1 == play_samples(pcm_out->pcm_buf, pcm_out->pcm_buf_size)) {
-				sprintf(log_msg_buf, "frame#%u play failed!", frame_count);
-				LOG_E("play_samples", log_msg_buf);
-			}
-			if (handle->output_flags & OUTPUT_FILE && fwrite(pcm_out->pcm_buf, 1, pcm_out->pcm_buf_size, handle->wav_ptr) != pcm_out->pcm_buf_size) {
-				sprintf(log_msg_buf, "frame#%u write failed!", frame_count);
-				LOG_E("write_samples", log_msg_buf);
-			}
-			pcm_out->write_off[0] = 0;
-			pcm_out->write_off[1] = 2;
+
+		PROFILE_END(&handle->profile, PROFILE_FRAME, frame_start);
+		if (timed) {
+			const uint64_t ns = clock_Nanos() - start;
+			if (handle->frame_times && handle->frame_times_count < handle->frame_times_len)
+				handle->frame_times[handle->frame_times_count++] = (uint32_t)ns;
+			if (handle->frame_hist)
+				hist_Record(handle->frame_hist, ns);
 		}
-	} while (decode_next_frame(cur_frame, handle->file_stream) != -1);
+	} while (next_frame(handle) != -1);
 
+	// the last period is usually partial
+	if (pcm_out->write_off[0])
+		decoder_flushPcm(handle);
+
+#ifdef MMP_PROFILE
+	handle->profile.run_ticks += __rdtsc() - run_ticks;
+	handle->profile.run_ns += clock_Nanos() - run_ns;
+#endif
 	return frame_count;
 }
+
+void decoder_flushPcm(struct decoder_handle* const handle)
+{
+	struct pcm_stream* const pcm_out = &handle->pcm;
+	PROFILE_BEGIN(start);
+	const uint32_t frames = pcm_out->write_off[0] / (pcm_out->sample_size * (pcm_out->planar ? 1 : pcm_out->channels));
+	const uint32_t len = frames * pcm_out->channels * pcm_out->sample_size;
+
+	// a partial period leaves a gap between the planes
+	if (pcm_out->planar && len < pcm_out->pcm_buf_size)
+		memmove(pcm_out->pcm_buf + len / 2, pcm_out->pcm_buf + pcm_out->audio_buf_size, len / 2);
+
+	if (handle->output_flags & OUTPUT_AUDIO && -1 == play_samples(pcm_out->pcm_buf, len))
+		LOG_E("play_samples", "play failed!");
+	if (handle->output_flags & OUTPUT_PACED && -1 == paced_play(pcm_out->pcm_buf, len))
+		LOG_E("paced_play", "paced output failed!");
+	if ((handle->output_flags & (OUTPUT_FILE | OUTPUT_PACED)) == OUTPUT_FILE && -1 == wav_Write(handle->wav, pcm_out->pcm_buf, len))
+		LOG_E("write_samples", "write failed!");
+	if (handle->output_flags & OUTPUT_CALLBACK)
+		handle->callback(handle->callback_arg, pcm_out->pcm_buf, frames);
+
+	rewind_pcm(pcm_out);
+	PROFILE_END(&handle->profile, PROFILE_OUTPUT, start);
+}
+
+int decoder_getProfile(const struct decoder_handle* const handle, struct decoder_profile* const profile)
+{
+#ifdef MMP_PROFILE
+	*profile = handle->profile;
+	return 0;
+#else
+	(void)handle;
+	(void)profile;
+	return -1;
+#endif
+}
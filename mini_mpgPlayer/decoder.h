@@ -4,6 +4,10 @@
 #include "bs.h"
 #include "frame.h"
 #include "audio.h"
+#include "wav.h"
+#include "profile.h"
+#include "histogram.h"
+#include "diag.h"
 #include <stdio.h>
 
 #define LOG(_Type, _Func, _Msg) fprintf(stderr, "[%c] %s:%d %s::%s -> %s\n", (_Type), __FILE__, __LINE__, __func__, (_Func), (_Msg))
@@ -11,7 +15,26 @@
 #define LOG_W(_Func, _Msg) LOG('W', _Func, _Msg)
 #define LOG_I(_Func, _Msg) LOG('I', _Func, _Msg)
 
-enum OUTPUT_FLAGS { OUTPUT_AUDIO = 0x1, OUTPUT_FILE = 0x2 };
+// OUTPUT_PACED: consume the PCM at the stream rate without a device (see paced.h),
+// with OUTPUT_FILE the file is written from the paced sink instead
+// OUTPUT_RAW: with OUTPUT_FILE, headerless PCM instead of RIFF/WAVE
+// OUTPUT_CALLBACK: every period is passed to decoder_handle::callback
+enum OUTPUT_FLAGS { OUTPUT_AUDIO = 0x1, OUTPUT_FILE = 0x2, OUTPUT_PACED = 0x4, OUTPUT_RAW = 0x8, OUTPUT_CALLBACK = 0x10 };
+// set in decoder_handle::decode_flags before decoder_Run
+// DECODE_CRC_CHECK: skip protected frames whose CRC-16 doesn't match
+// DECODE_QUIET: nothing about the stream and its tags on stdout
+// DECODE_PROFILE_SUMMARY: with MMP_PROFILE, print the stage times to stderr in decoder_Release
+// DECODE_REFERENCE: requantization to synthesis in double precision, to measure the float path against (see accuracy.h),
+// full rate and no downmix only
+enum DECODE_FLAGS { DECODE_CRC_CHECK = 0x1, DECODE_QUIET = 0x2, DECODE_PROFILE_SUMMARY = 0x4, DECODE_REFERENCE = 0x8 };
+
+// CHANNEL_NATIVE: as many output channels as the stream has, mono is not duplicated
+// CHANNEL_DOWNMIX: mono, (L + R) / 2 of stereo streams
+// CHANNEL_LEFT/RIGHT: mono, only the selected channel of a stereo stream is decoded
+enum CHANNEL_MODE { CHANNEL_STEREO, CHANNEL_NATIVE, CHANNEL_DOWNMIX, CHANNEL_LEFT, CHANNEL_RIGHT };
+
+// planar: the planes are frames * sample size bytes apart
+typedef void (*output_callback)(void* arg, const uint8_t* pcm, uint32_t frames);
 
 struct decoder_handle {
 	struct bs* file_stream;
@@ -21,12 +44,45 @@ struct decoder_handle {
 	struct mpeg_frame cur_frame;
 
 	enum OUTPUT_FLAGS output_flags;
+	enum DECODE_FLAGS decode_flags;
+	uint32_t crc_error_count;
+
+	// output buffering, set before decoder_Run, 0: defaults (8 frames per period, 8 periods)
+	uint32_t period_samples;	// rounded up to whole granules (576 >> rate_shift samples)
+	uint32_t period_count;		// periods queued in the sink, at least 2
+
+	// output format, set before decoder_Run, 0: interleaved s16 stereo
+	enum SAMPLE_FORMAT sample_format;
+	enum CHANNEL_MODE channel_mode;
+	uint8_t planar;			// OUTPUT_CALLBACK only
+	uint8_t rate_shift;		// 1: half, 2: quarter of the stream rate, from the lowest 16 or 8 subbands
+	output_callback callback;
+	void* callback_arg;
+
+	// optional, the decode time of every frame in ns, at most frame_times_len of them
+	uint32_t* frame_times;
+	uint32_t frame_times_len;
+	uint32_t frame_times_count;
+	struct latency_hist* frame_hist;	// optional, gets the decode time of every frame in ns
+
+	// stream conditions, the sink is diag_logSink to stderr by default, diag.sink = NULL for counters only
+	struct decoder_diag diag;
+
+	// MMP_PROFILE only, profile_traceBegin(&profile, ...) before decoder_Run records the timeline
+	struct decoder_profile profile;
+
 	struct pcm_stream pcm;
-	FILE* wav_ptr;
+	struct wav_sink* wav;
 };
 
 struct decoder_handle* decoder_Init(const char* const mp3_file_name, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name);
+// the data is not copied and has to outlive the handle
+struct decoder_handle* decoder_InitMemory(const void* const mp3_data, const uint32_t mp3_size, const enum OUTPUT_FLAGS output_flags, const char* const wav_file_name);
 void decoder_Release(struct decoder_handle** const handle);
 uint32_t decoder_Run(struct decoder_handle* const handle);
+// hand the pcm_stream over to the outputs and rewind it, called per granule once a period is full
+void decoder_flushPcm(struct decoder_handle* const handle);
+// the counters of the runs so far, -1 without MMP_PROFILE
+int decoder_getProfile(const struct decoder_handle* const handle, struct decoder_profile* const profile);
 
 #endif // !_MMP_DECODER_H_
@@ -0,0 +1,67 @@
+#include "diag.h"
+#include <string.h>
+
+static const char* const code_str[DIAG_CODES] = {
+	"resync", "sync_lost", "sideinfo", "part2_3_zero", "big_values", "scalefac_compress", "block_type", "scfsi_short", "mixed_block",
+	"maindata_miss", "maindata_overflow", "huff_big_values", "huff_count1", "part3_overrun", "part3_underrun", "bad_stereo"
+};
+
+// the sink lines, fixed so that nothing is formatted on the decode thread
+static const char* const line_str[DIAG_CODES] = {
+	"[W] bytes skipped to find the next frame\n",
+	"[E] no frame found within 1MB, stopped\n",
+	"[E] frame skipped, invalid side info\n",
+	"[W] part2_3_length == 0\n",
+	"[W] big_values > 288, clamped\n",
+	"[W] scalefac_compress != 0 when part2_3_length == 0, cleared\n",
+	"[E] block_type == 0 when win_switch_flag == 1\n",
+	"[E] block_type == 2 when scfsi != 0\n",
+	"[I] mixed blocks\n",
+	"[E] frame skipped, main data missing from the bit reservoir\n",
+	"[E] the bit reservoir overflowed\n",
+	"[E] invalid Huffman code in the big_values region\n",
+	"[E] invalid Huffman code in the count1 region\n",
+	"[W] the Huffman data runs past part2_3_length\n",
+	"[W] bits left after the Huffman data\n",
+	"[W] intensity stereo with different block types, ignored\n"
+};
+
+void diag_Reset(struct decoder_diag* const diag)
+{
+	memset(diag->count, 0, sizeof(diag->count));
+	memset(diag->reported, 0, sizeof(diag->reported));
+	diag->frame = 0;
+}
+
+void diag_Raise(struct decoder_diag* const diag, const enum DIAG_CODE code)
+{
+	const uint32_t interval = diag->interval ? diag->interval : DIAG_DEFAULT_INTERVAL;
+
+	++diag->count[code];
+	if (diag->sink && (!diag->reported[code] || diag->frame + 1 - diag->reported[code] >= interval)) {
+		diag->reported[code] = diag->frame + 1;
+		diag->sink(diag->sink_arg, code, diag->frame, diag->count[code]);
+	}
+}
+
+const char* diag_codeName(const enum DIAG_CODE code)
+{
+	return code < DIAG_CODES ? code_str[code] : "?";
+}
+
+void diag_Print(FILE* const fp, const struct decoder_diag* const diag)
+{
+	int i;
+
+	for (i = 0; i < DIAG_CODES; ++i) {
+		if (diag->count[i])
+			fprintf(fp, "%-18s %u\n", code_str[i], diag->count[i]);
+	}
+}
+
+void diag_logSink(void* arg, const enum DIAG_CODE code, const uint32_t frame, const uint32_t count)
+{
+	(void)frame;
+	(void)count;
+	fputs(line_str[code], (FILE*)arg);
+}
@@ -0,0 +1,56 @@
+#ifndef _MMP_DIAG_H_
+#define _MMP_DIAG_H_ 1
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+* Stream conditions counted per decoder_handle. The decode thread only bumps a counter and, rate limited,
+* hands the code to the sink, the text is made up off the hot path (diag_Print, or the sink itself).
+*/
+enum DIAG_CODE {
+	DIAG_RESYNC,			// bytes skipped to find the next frame
+	DIAG_SYNC_LOST,			// no frame within 1MB, the decoding stops
+	DIAG_SIDEINFO,			// frame skipped, invalid side info (the cause is counted too)
+	DIAG_PART2_3_ZERO,		// part2_3_length == 0, the granule is silent
+	DIAG_BIG_VALUES,		// big_values > 288, clamped
+	DIAG_SCALEFAC_COMPRESS,	// scalefac_compress != 0 without part2_3_length, cleared
+	DIAG_BLOCK_TYPE,		// block_type 0 with window switching
+	DIAG_SCFSI_SHORT,		// short blocks with scfsi
+	DIAG_MIXED_BLOCK,		// not an error
+	DIAG_MAINDATA_MISS,		// main_data_begin reaches back past the bit reservoir, frame skipped
+	DIAG_MAINDATA_OVERFLOW,	// the bit reservoir is full
+	DIAG_HUFF_BIG_VALUES,	// invalid code in the big_values region
+	DIAG_HUFF_COUNT1,		// invalid count1 code, or its sign bits past part3_length
+	DIAG_PART3_OVERRUN,		// the Huffman data ran past part2_3_length
+	DIAG_PART3_UNDERRUN,	// bits left over after the Huffman data
+	DIAG_BAD_STEREO,		// intensity stereo with different block types in the channels, M/S only
+	DIAG_CODES
+};
+
+// count: of the code so far, frame: the frame it was raised in
+typedef void (*diag_sink)(void* arg, const enum DIAG_CODE code, const uint32_t frame, const uint32_t count);
+
+struct decoder_diag {
+	uint32_t count[DIAG_CODES];
+	uint32_t reported[DIAG_CODES];	// frame + 1 of the last call to the sink, 0: none yet
+
+	uint32_t frame;		// the frame being decoded, set by decoder_Run
+	// NULL: counters only. A code goes to the sink the first time, then at most once every interval frames
+	diag_sink sink;
+	void* sink_arg;
+	uint32_t interval;	// 0: DIAG_DEFAULT_INTERVAL
+};
+
+#define DIAG_DEFAULT_INTERVAL	256
+
+// clears the counters, the sink is kept
+void diag_Reset(struct decoder_diag* const diag);
+void diag_Raise(struct decoder_diag* const diag, const enum DIAG_CODE code);
+const char* diag_codeName(const enum DIAG_CODE code);
+// one line per raised code, no output when nothing was raised
+void diag_Print(FILE* const fp, const struct decoder_diag* const diag);
+// the default sink, a fixed line per code to the FILE* in arg
+void diag_logSink(void* arg, const enum DIAG_CODE code, const uint32_t frame, const uint32_t count);
+
+#endif // !_MMP_DIAG_H_
@@ -1,4 +1,5 @@
 #include "frame.h"
+#include <immintrin.h>
 
 // __bitrate_table[lsf][layer - 1][bitrate_index]
 static const unsigned short _bitrate_table[2][3][15] = {
@@ -73,57 +74,174 @@ static unsigned valid_header(const uint32_t h)
 	return 0;
 }
 
-static uint32_t _frame_count = 0;
-static int sync_frame(struct mpeg_header* const header, struct bs* const bstream)
+static uint32_t get_frame_size(const struct mpeg_header* const header, const uint32_t bitrate, const uint32_t samplingrate)
 {
-	uint32_t h = 0, need_read = 4, skipped = 0, tmp;
+	// _samples1frame_table[header->version][header->layer] * header->bitrate * 1000 / 8 / header->samplingrate + header->padding? (header->layer == MPEG_LAYER_1? 4: 1): 0;
 
-	while (need_read) {
-		if ((tmp = bs_Avaliable(bstream)) < need_read) {
-			tmp = need_read + 4 - tmp;
-			if (tmp != bs_Prefect(bstream, tmp))
-				return -1;
-		}
+	if (header->layer == LAYER_1)
+		return (12 * bitrate * 1000 / samplingrate + header->padding_bit) * 4;
+	else if (header->layer == LAYER_2 || (header->version == VERSION_10 && header->layer == LAYER_3))
+		return 144 * bitrate * 1000 / samplingrate + header->padding_bit;
+	else if (header->version != VERSION_10 && header->layer == LAYER_3)
+		return 72 * bitrate * 1000 / samplingrate + header->padding_bit;
 
-		while (need_read) {
-			h <<= 8;
-			h |= bs_readByte(bstream);
-			--need_read;
-		}
+	return 0;
+}
 
-		if (need_read = valid_header(h)) {
-			skipped += need_read;
-			if (skipped >> 20) {
-				fprintf(stderr, "[E] already skipped %ubytes\n", skipped);
-				return -1;
-			}
+/*
+* Everything derived from the header except the channel mode, keyed by header bits 9..20
+* (padding, sampling_frequency, bitrate_index, protection_bit, layer, version)
+*/
+struct frame_info {
+	uint16_t frame_size;
+	uint16_t bitrate;
+	uint16_t samplingrate;
+	uint16_t pcm_size;
+	uint8_t sideinfo_size[2];	// sideinfo_size[nch - 1]
+};
+
+#define FRAME_INFO_KEY(_h) (((_h) >> 9) & 0xfff)
+
+static struct frame_info _frame_info_table[4096];
+
+/*
+CRC-16 (x^16 + x^15 + x^2 + 1), slice-by-4
+
+_crc16_table[0][i] = CRC of the byte i
+_crc16_table[k][i] = CRC of the byte i followed by k zero bytes
+*/
+static uint16_t _crc16_table[4][256];
+
+void init_frame_tabs(void)
+{
+	struct mpeg_header header;
+	uint32_t key, lsf, i, k, crc;
+
+	for (i = 0; i < 256; ++i) {
+		crc = i << 8;
+		for (k = 0; k < 8; ++k)
+			crc = (crc << 1) ^ (crc & 0x8000 ? 0x8005 : 0);
+		_crc16_table[0][i] = (uint16_t)crc;
+	}
+	for (k = 1; k < 4; ++k) {
+		for (i = 0; i < 256; ++i)
+			_crc16_table[k][i] = (uint16_t)(_crc16_table[k - 1][i] << 8) ^ _crc16_table[0][_crc16_table[k - 1][i] >> 8];
+	}
+
+	for (key = 0; key < 4096; ++key) {
+		struct frame_info* const info = &_frame_info_table[key];
+
+		decode_header(&header, key << 9);
+		if (header.version == VERSION_RESERVED || header.layer == LAYER_RESERVED || header.bitrate_index == 0xf || header.sampling_frequency == 3)
 			continue;
+
+		lsf = header.version != VERSION_10;
+		info->bitrate = _bitrate_table[lsf][header.layer - 1][header.bitrate_index];
+		info->samplingrate = _samplingrate_table[header.version][header.sampling_frequency];
+		info->frame_size = header.bitrate_index ? get_frame_size(&header, info->bitrate, info->samplingrate) : 0;
+		info->pcm_size = lsf ? 2304U : 4608U;
+		if (header.layer == LAYER_3) {
+			info->sideinfo_size[0] = _l3_sideinfo_size[lsf][0];
+			info->sideinfo_size[1] = _l3_sideinfo_size[lsf][1];
 		}
+	}
+}
 
-		decode_header(header, h);
+static uint32_t read_header(const uint8_t* const p)
+{
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/*
+* Position of the first 0xFF 0xEx pair in [p, end), 16 bytes per step.
+* Returns end - p - 1 (the last byte, which may start a pair) when no pair is found.
+*/
+static uint32_t scan_sync(const uint8_t* const p, const uint8_t* const end)
+{
+	const __m128i i16_ff = _mm_set1_epi8((char)0xff), i16_e0 = _mm_set1_epi8((char)0xe0);
+	const uint8_t* cur = p;
+	int mask;
+
+	for (; cur + 17 <= end; cur += 16) {
+		__m128i i16_b0 = _mm_loadu_si128((const __m128i*)cur), i16_b1 = _mm_loadu_si128((const __m128i*)(cur + 1));
+		i16_b0 = _mm_cmpeq_epi8(i16_b0, i16_ff);
+		i16_b1 = _mm_cmpeq_epi8(_mm_and_si128(i16_b1, i16_e0), i16_e0);
+		if ((mask = _mm_movemask_epi8(_mm_and_si128(i16_b0, i16_b1)))) {
+#ifdef _MSC_VER
+			unsigned long idx;
+			_BitScanForward(&idx, mask);
+			return (uint32_t)(cur - p) + idx;
+#else
+			return (uint32_t)(cur - p) + __builtin_ctz(mask);
+#endif
+		}
 	}
 
-	if (skipped) {
-		fprintf(stderr, "[W] frame#%u skipped %ubytes\n", _frame_count, skipped);
+	for (; cur + 1 < end; ++cur) {
+		if (cur[0] == 0xff && (cur[1] & 0xe0) == 0xe0)
+			break;
 	}
 
-	++_frame_count;
+	return (uint32_t)(cur - p);
+}
+
+/*
+* The first frame of a stream, or one found while resyncing, must be followed by a header of the same stream
+* (version, layer, sampling_frequency), unless the stream ends first.
+*/
+static int confirm_header(struct bs* const bstream, const uint32_t h)
+{
+	const uint32_t frame_size = _frame_info_table[FRAME_INFO_KEY(h)].frame_size;
+	uint32_t avail, next;
+
+	if (!frame_size)
+		return 0;
+
+	if ((avail = bs_Avaliable(bstream)) < frame_size + 4) {
+		bs_Prefect(bstream, frame_size + 4 - avail);
+		if (bs_Avaliable(bstream) < frame_size + 4)
+			return 0;
+	}
+
+	next = read_header(bstream->byte_ptr + frame_size);
+	if (valid_header(next) || (next & 0xfffe0c00) != (h & 0xfffe0c00))
+		return -1;
 
 	return 0;
 }
 
-static uint32_t get_frame_size(const struct mpeg_frame* const frame)
+// *skipped: the bytes in front of the frame, or of the 1MB given up on, 0 at the end of the stream
+static int sync_frame(struct mpeg_header* const header, struct bs* const bstream, uint32_t* const h, uint32_t* const skipped)
 {
-	// _samples1frame_table[header->version][header->layer] * header->bitrate * 1000 / 8 / header->samplingrate + header->padding? (header->layer == MPEG_LAYER_1? 4: 1): 0;
+	uint32_t off, avail;
 
-	const struct mpeg_header* const header = &frame->header;
+	*skipped = 0;
 
-	if (header->layer == LAYER_1)
-		return (12 * frame->bitrate * 1000 / frame->samplingrate + header->padding_bit) * 4;
-	else if (header->layer == LAYER_2 || (header->version == VERSION_10 && header->layer == LAYER_3))
-		return 144 * frame->bitrate * 1000 / frame->samplingrate + header->padding_bit;
-	else if (header->version != VERSION_10 && header->layer == LAYER_3)
-		return 72 * frame->bitrate * 1000 / frame->samplingrate + header->padding_bit;
+	for (;;) {
+		if ((avail = bs_Avaliable(bstream)) < 4) {
+			bs_Prefect(bstream, bs_Capacity(bstream) - avail);
+			if ((avail = bs_Avaliable(bstream)) < 4) {
+				*skipped = 0;
+				return -1;
+			}
+		}
+
+		*h = read_header(bstream->byte_ptr);
+		if (!valid_header(*h)) {
+			if ((!*skipped && bstream->synced) || confirm_header(bstream, *h) == 0)
+				break;
+		}
+
+		off = scan_sync(bstream->byte_ptr + 1, bstream->end_ptr) + 1;
+		bstream->byte_ptr += off;
+		*skipped += off;
+		if (*skipped >> 20)
+			return -1;
+	}
+
+	bstream->byte_ptr += 4;
+	decode_header(header, *h);
+	bstream->synced = 1;
 
 	return 0;
 }
@@ -131,18 +249,15 @@ static uint32_t get_frame_size(const struct mpeg_frame* const frame)
 int decode_next_frame(struct mpeg_frame* const frame, struct bs* const bstream)
 {
 	struct mpeg_header* const header = &frame->header;
+	const struct frame_info* info;
+	uint32_t h;
 
-	if (sync_frame(header, bstream) == -1) {
+	if (sync_frame(header, bstream, &h, &frame->skipped) == -1) {
 		return -1;
 	}
 
-#if 0
-	// test
-	if (header->sampling_frequency != 0) {
-		printf("\n\n%u: %u\n\n", _frame_count, header->sampling_frequency);
-	}
-	// end test
-#endif
+	info = &_frame_info_table[FRAME_INFO_KEY(h)];
+	frame->raw_header = h;
 
 	frame->is_lsf = header->version != VERSION_10;
 	frame->is_freeformat = header->bitrate_index == 0;
@@ -152,13 +267,13 @@ int decode_next_frame(struct mpeg_frame* const frame, struct bs* const bstream)
 
 	frame->nch = header->mode == MODE_Mono ? 1 : 2;
 
-	frame->bitrate = _bitrate_table[frame->is_lsf][header->layer - 1][header->bitrate_index];
-	frame->samplingrate = _samplingrate_table[header->version][header->sampling_frequency];
+	frame->bitrate = info->bitrate;
+	frame->samplingrate = info->samplingrate;
 
-	frame->frame_size = !frame->is_freeformat ? get_frame_size(frame) : 0;
-	frame->sideinfo_size = header->layer == LAYER_3 ? _l3_sideinfo_size[frame->is_lsf][frame->nch - 1] : 0;
+	frame->frame_size = info->frame_size;
+	frame->sideinfo_size = info->sideinfo_size[frame->nch - 1];
 
-	frame->pcm_size = (frame->is_lsf ? 2304U : 4608U)/* >> (frame->nch == 1)*/;
+	frame->pcm_size = info->pcm_size/* >> (frame->nch == 1)*/;
 
 	frame->header_size = 4;
 	if (!header->protection_bit)
@@ -184,3 +299,32 @@ int decode_next_frame(struct mpeg_frame* const frame, struct bs* const bstream)
 
 	return 0;
 }
+
+static uint32_t crc16_update(uint32_t crc, const uint8_t* p, uint32_t len)
+{
+	for (; len >= 4; len -= 4, p += 4) {
+		crc = _crc16_table[3][(crc >> 8) ^ p[0]] ^ _crc16_table[2][(crc & 0xff) ^ p[1]]
+			^ _crc16_table[1][p[2]] ^ _crc16_table[0][p[3]];
+	}
+	while (len--)
+		crc = ((crc << 8) & 0xffff) ^ _crc16_table[0][(crc >> 8) ^ *p++];
+
+	return crc;
+}
+
+/*
+* The CRC-16 of a protected frame covers the last 16 bits of the header and the side info.
+* Returns -1 on mismatch, 0 otherwise (also for unprotected frames).
+*/
+int check_crc16(const struct mpeg_frame* const frame, const uint8_t* const sideinfo)
+{
+	const uint8_t h[2] = { (uint8_t)(frame->raw_header >> 8), (uint8_t)frame->raw_header };
+
+	if (frame->header.protection_bit)
+		return 0;
+
+	if (crc16_update(crc16_update(0xffff, h, 2), sideinfo, frame->sideinfo_size) != frame->crc16_sum)
+		return -1;
+
+	return 0;
+}
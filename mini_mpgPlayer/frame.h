@@ -25,6 +25,7 @@ struct mpeg_header {
 
 struct mpeg_frame {
 	struct mpeg_header header;
+	uint32_t raw_header;
 	uint16_t crc16_sum;
 
 	bool is_lsf;
@@ -41,8 +42,11 @@ struct mpeg_frame {
 	uint32_t maindata_size;
 
 	uint32_t pcm_size;
+	uint32_t skipped;	// bytes skipped to sync to this frame
 };
 
+void init_frame_tabs(void);
 int decode_next_frame(struct mpeg_frame* const frame, struct bs* const bstream);
+int check_crc16(const struct mpeg_frame* const frame, const uint8_t* const sideinfo);
 
 #endif // !_MMP_FRAME_H_
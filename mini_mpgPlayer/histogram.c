@@ -0,0 +1,78 @@
+#include "histogram.h"
+#include <string.h>
+#include <math.h>
+
+static uint32_t bucket_index(const uint64_t value)
+{
+	uint32_t shift = 0;
+
+	if (value < 2 * HIST_SUB_BUCKETS)
+		return (uint32_t)value;
+	if (value >> HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+
+	while (value >> shift >= 2 * HIST_SUB_BUCKETS)
+		++shift;
+
+	return 2 * HIST_SUB_BUCKETS + (shift - 1) * HIST_SUB_BUCKETS + (uint32_t)(value >> shift) - HIST_SUB_BUCKETS;
+}
+
+static uint64_t bucket_upper(const uint32_t index)
+{
+	uint32_t shift, sub;
+
+	if (index < 2 * HIST_SUB_BUCKETS)
+		return index;
+
+	shift = (index - 2 * HIST_SUB_BUCKETS) / HIST_SUB_BUCKETS + 1;
+	sub = (index - 2 * HIST_SUB_BUCKETS) % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS;
+
+	return ((uint64_t)(sub + 1) << shift) - 1;
+}
+
+void hist_Reset(struct latency_hist* const hist)
+{
+	memset(hist, 0, sizeof(struct latency_hist));
+	hist->min = UINT64_MAX;
+}
+
+void hist_Record(struct latency_hist* const hist, const uint64_t value)
+{
+	++hist->counts[bucket_index(value)];
+	++hist->total;
+	hist->sum += (double)value;
+	if (value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+}
+
+uint64_t hist_Percentile(const struct latency_hist* const hist, const double percentile)
+{
+	uint64_t rank, seen = 0;
+	uint32_t i;
+
+	if (!hist->total)
+		return 0;
+
+	// nearest rank: the smallest value with at least percentile % of the records at or below it
+	rank = (uint64_t)ceil(percentile / 100.0 * hist->total);
+	if (rank < 1)
+		rank = 1;
+	else if (rank > hist->total)
+		rank = hist->total;
+
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+		if ((seen += hist->counts[i]) >= rank) {
+			const uint64_t upper = bucket_upper(i);
+			return upper < hist->max ? upper : hist->max;
+		}
+	}
+
+	return hist->max;
+}
+
+double hist_Mean(const struct latency_hist* const hist)
+{
+	return hist->total ? hist->sum / hist->total : 0;
+}
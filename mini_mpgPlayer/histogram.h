@@ -0,0 +1,28 @@
+#ifndef _MMP_HISTOGRAM_H_
+#define _MMP_HISTOGRAM_H_ 1
+
+#include <stdint.h>
+
+/*
+* HDR style latency histogram: exact below 64, above it 32 linear buckets per power of two,
+* so any recorded value is reported within 1/32 (3.1%). Values from 2^40 up share the last bucket.
+*/
+#define HIST_SUB_BUCKETS	32
+#define HIST_MAX_BITS		40
+#define HIST_BUCKETS		(2 * HIST_SUB_BUCKETS + (HIST_MAX_BITS - 6) * HIST_SUB_BUCKETS)
+
+struct latency_hist {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+};
+
+void hist_Reset(struct latency_hist* const hist);
+void hist_Record(struct latency_hist* const hist, const uint64_t value);
+// the highest value equivalent to the one at percentile (0 - 100), 0 when empty
+uint64_t hist_Percentile(const struct latency_hist* const hist, const double percentile);
+double hist_Mean(const struct latency_hist* const hist);
+
+#endif // !_MMP_HISTOGRAM_H_
@@ -0,0 +1,15 @@
+#include "json.h"
+#include <stdio.h>
+
+void json_PrintString(const char* str)
+{
+	putchar('"');
+	for (; *str; ++str) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", (unsigned char)*str);
+		else putchar(*str);
+	}
+	putchar('"');
+}
@@ -0,0 +1,7 @@
+#ifndef _MMP_JSON_H_
+#define _MMP_JSON_H_ 1
+
+// print str to stdout as a quoted JSON string, with " \ and the control characters escaped
+void json_PrintString(const char* str);
+
+#endif // !_MMP_JSON_H_
@@ -12,6 +12,7 @@
 #define SSLIMIT	18
 
 #define M_PI       3.14159265358979323846
+#define M_SQRT2    1.41421356237309504880
 
 // scalefactor bit lengths
 static const unsigned char sflen_table[2][16] = {
@@ -54,10 +55,10 @@ static struct {
 	const unsigned short* width_short;
 } cur_sfb_table;
 
-// scalefactor band preemphasis (used only when preflag is set)
-static const unsigned char pretab[2][21] = {
+// scalefactor band preemphasis (used only when preflag is set), band 21 has none but the long block loops read it
+static const unsigned char pretab[2][22] = {
 	{ 0 },
-	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2 }
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0 }
 };
 
 static struct {
@@ -71,6 +72,17 @@ static float gain_powis[8207];
 // gain_pow2_is[i] = 2^i
 static float gain_pow2[256 + 118 + 4];
 
+/*
+* The tables in double precision for the reference path (DECODE_REFERENCE), the float ones above
+* and below are rounded from them.
+*/
+static double gain_powis_ref[8207];
+static double gain_pow2_ref[256 + 118 + 4];
+static double cs_ref[8], ca_ref[8];
+static double imdct_s_ref[6][12];
+static double imdct_l_ref[18][36];
+static double imdct_window_ref[4][36];
+
 /*
 coefficients for aliasing reduction
 
@@ -91,6 +103,8 @@ static float imdct_s[6][12];
 static float imdct_l[18][36];
 
 static float imdct_window[4][36];
+// the frequency inversion of the odd subbands, every second value negated
+static float imdct_window_inv[4][36];
 
 #if 0
 /*
@@ -109,79 +123,90 @@ static float window_l[36];
 #endif
 
 /*
-coefficients for intensity stereo processing
+coefficients for intensity stereo processing, is_pos 0 - 6
 
 is_ratio[i] = tan(i * (PI / 12))
-is_table[i] = is_ratio[i] / (1 + is_ratio[i])
+left: is_ratio[i] / (1 + is_ratio[i]), right: 1 / (1 + is_ratio[i])
 */
-static double is_ratio[6];
-//static float is_table[7];
+static double is_lr_ref[7][2];
+// [is_MS][is_pos][l/r], M/S streams are requantized with 1/sqrt(2), their I/S bands take it back
+static float is_lr[2][7][2];
 
 
 static float overlapp[2][SBLIMIT * SSLIMIT];
+static double overlapp_ref[2][SBLIMIT * SSLIMIT];
+// the retained subbands * SSLIMIT, less than a granule for the reduced rate synthesis
+static unsigned hybrid_len = SBLIMIT * SSLIMIT;
+// the hybrid filter output, out[ss][sb]: a time slot is the contiguous s[32] of the synthesis
+static MMP_ALIGN(16) float hybrid_out[2][SSLIMIT][SBLIMIT];
 
 
-static int l3_decode_sideinfo(struct bs* const sideinfo_stream, struct l3_sideinfo* const si, const int nch)
+/*
+* The side info is read with bs_peekBits64: after main_data_begin, private_bits and scfsi (20 bits, 18 for mono)
+* every granule and channel is 59 bits in either layout, one word each, the fields at fixed shifts.
+*/
+static int l3_decode_sideinfo(struct bs* const sideinfo_stream, struct l3_sideinfo* const si, const int nch, struct decoder_diag* const diag)
 {
-	int gr, ch, region;
-	char log_msg_buf[64];
-
-	si->main_data_begin = bs_readBits(sideinfo_stream, 9);
-	si->private_bits = bs_readBits(sideinfo_stream, nch == 1 ? 5 : 3);	// private_bits
+	const unsigned private_len = nch == 1 ? 5 : 3;
+	uint64_t w = bs_peekBits64(sideinfo_stream);
+	unsigned off = 9 + private_len;
+	int gr, ch, i;
 
+	si->main_data_begin = (uint16_t)(w >> 55);
+	si->private_bits = (uint8_t)(w >> (64 - off)) & ((1 << private_len) - 1);
 	for (ch = 0; ch < nch; ++ch) {
-		for (int scfsi_band = 0; scfsi_band < 4; ++scfsi_band)
-			si->scfsi[ch][scfsi_band] = bs_readBit(sideinfo_stream);
+		for (i = 0; i < 4; ++i)
+			si->scfsi[ch][i] = (uint8_t)(w >> (63 - off++)) & 1;
 	}
+	bs_skipBits(sideinfo_stream, off);
 
 	for (gr = 0; gr < 2; ++gr) {
 		for (ch = 0; ch < nch; ++ch) {
 			struct ch_info* const cur_ch = si->gr[gr].ch + ch;
 
-			cur_ch->part2_3_len = bs_readBits(sideinfo_stream, 12);
-			if (cur_ch->part2_3_len == 0) {
-				sprintf(log_msg_buf, "gr%dch%d's part2_3_len==0!", gr, ch);
-				LOG_W("sideinfo_check", log_msg_buf);
-			}
+			w = bs_peekBits64(sideinfo_stream);
+			bs_skipBits(sideinfo_stream, 59);
 
-			cur_ch->big_values = bs_readBits(sideinfo_stream, 9);
+			cur_ch->part2_3_len = (uint16_t)(w >> 52);
+			if (cur_ch->part2_3_len == 0)
+				diag_Raise(diag, DIAG_PART2_3_ZERO);
+
+			cur_ch->big_values = (uint16_t)(w >> 43) & 0x1ff;
 			if (cur_ch->big_values > 288) {
-				sprintf(log_msg_buf, "gr%dch%d's big_values==%hu too large!", gr, ch, cur_ch->big_values);
-				LOG_W("sideinfo_check", log_msg_buf);
+				diag_Raise(diag, DIAG_BIG_VALUES);
 				cur_ch->big_values = 288;
 			}
 
-			cur_ch->global_gain = bs_readBits(sideinfo_stream, 8);
-			cur_ch->scalefac_compress = bs_readBits(sideinfo_stream, 4);
+			cur_ch->global_gain = (uint16_t)(w >> 35) & 0xff;
+			cur_ch->scalefac_compress = (uint16_t)(w >> 31) & 0xf;
 			if (cur_ch->part2_3_len == 0) {
 				if (cur_ch->scalefac_compress) {
-					sprintf(log_msg_buf, "gr%dch%d's scalefac_compress==%hu when part2_3_len==0!", gr, ch, cur_ch->scalefac_compress);
-					LOG_W("sideinfo_check", log_msg_buf);
+					diag_Raise(diag, DIAG_SCALEFAC_COMPRESS);
 					cur_ch->scalefac_compress = 0;
 				}
 			}
 
-			cur_ch->win_switch_flag = bs_readBit(sideinfo_stream);
+			cur_ch->win_switch_flag = (uint8_t)(w >> 30) & 1;
 			if (cur_ch->win_switch_flag == 1) {
-				cur_ch->block_type = bs_readBits(sideinfo_stream, 2);
+				cur_ch->block_type = (uint8_t)(w >> 28) & 3;
 				if (cur_ch->block_type == 0) {
-					LOG_E("sideinfo_check", "block_type==0 when win_switch_flag==1!");
+					diag_Raise(diag, DIAG_BLOCK_TYPE);
 					return -1;
 				} else if (cur_ch->block_type == 2 && *(unsigned*)(si->scfsi[ch]) != 0) {
-					LOG_E("sideinfo_check", "block_type==2 when scfsi!=0!");
+					diag_Raise(diag, DIAG_SCFSI_SHORT);
 					return -1;
 				}
 
-				cur_ch->mixed_block_flag = bs_readBit(sideinfo_stream);
-				if (cur_ch->block_type == 2 && cur_ch->mixed_block_flag == 1) {
-					LOG_W("sideinfo_check", "block_type==2 when mixed_block_flag==1!");
-				}
+				cur_ch->mixed_block_flag = (uint8_t)(w >> 27) & 1;
+				if (cur_ch->block_type == 2 && cur_ch->mixed_block_flag == 1)
+					diag_Raise(diag, DIAG_MIXED_BLOCK);
 
-				for (region = 0; region < 2; ++region)
-					cur_ch->table_select[region] = bs_readBits(sideinfo_stream, 5);
+				cur_ch->table_select[0] = (uint8_t)(w >> 22) & 0x1f;
+				cur_ch->table_select[1] = (uint8_t)(w >> 17) & 0x1f;
 				cur_ch->table_select[2] = 0;
-				for (int window = 0; window < 3; ++window)
-					cur_ch->subblock_gain[window] = bs_readBits(sideinfo_stream, 3);
+				cur_ch->subblock_gain[0] = (uint8_t)(w >> 14) & 7;
+				cur_ch->subblock_gain[1] = (uint8_t)(w >> 11) & 7;
+				cur_ch->subblock_gain[2] = (uint8_t)(w >> 8) & 7;
 
 				if (cur_ch->block_type == 2 && cur_ch->mixed_block_flag == 0)
 					cur_ch->region0_count = 8;
@@ -191,104 +216,166 @@ static int l3_decode_sideinfo(struct bs* const sideinfo_stream, struct l3_sidein
 				cur_ch->block_type = 0;
 				cur_ch->mixed_block_flag = 0;
 
-				for (region = 0; region < 3; ++region)
-					cur_ch->table_select[region] = bs_readBits(sideinfo_stream, 5);
-
-				cur_ch->region0_count = bs_readBits(sideinfo_stream, 4);
-				cur_ch->region1_count = bs_readBits(sideinfo_stream, 3);
+				cur_ch->table_select[0] = (uint8_t)(w >> 25) & 0x1f;
+				cur_ch->table_select[1] = (uint8_t)(w >> 20) & 0x1f;
+				cur_ch->table_select[2] = (uint8_t)(w >> 15) & 0x1f;
+				cur_ch->region0_count = (uint8_t)(w >> 11) & 0xf;
+				cur_ch->region1_count = (uint8_t)(w >> 8) & 7;
 			}
-			cur_ch->preflag = bs_readBit(sideinfo_stream);
-			cur_ch->scalefac_scale = bs_readBit(sideinfo_stream);
-			cur_ch->count1table_select = bs_readBit(sideinfo_stream);
+			cur_ch->preflag = (uint8_t)(w >> 7) & 1;
+			cur_ch->scalefac_scale = (uint8_t)(w >> 6) & 1;
+			cur_ch->count1table_select = (uint8_t)(w >> 5) & 1;
 		}
 	}
 
 	return 0;
 }
 
+// n scalefactors of slen bits, as many per bs_peekBits64 as fit in the word
+static void l3_read_scf(struct bs* const maindata_stream, const unsigned slen, unsigned n, unsigned* scf)
+{
+	const unsigned mask = (1u << slen) - 1;
+
+	if (!slen) {
+		memset(scf, 0, n * sizeof(unsigned));
+		return;
+	}
+	while (n) {
+		const uint64_t w = bs_peekBits64(maindata_stream);
+		const unsigned k = n < 64 / slen ? n : 64 / slen;
+		unsigned i;
+
+		for (i = 0; i < k; ++i)
+			scf[i] = (unsigned)(w >> (64 - slen * (i + 1))) & mask;
+		bs_skipBits(maindata_stream, slen * k);
+		scf += k;
+		n -= k;
+	}
+}
+
 static void l3_decode_scalefactors(struct bs* const maindata_stream, struct ch_info* const cur_ch, const struct l3_sideinfo* const si, const int gr, const int ch, unsigned scf[2][39])
 {
 	const unsigned char slen0 = sflen_table[0][cur_ch->scalefac_compress];
 	const unsigned char slen1 = sflen_table[1][cur_ch->scalefac_compress];
-	int sb;
 
 	if (cur_ch->win_switch_flag == 1 && cur_ch->block_type == 2) {
 		if (cur_ch->mixed_block_flag == 1) {
 			// MIXED block
 			cur_ch->part2_len = slen0 * 17 + slen1 * 18;
-			for (sb = 0; sb < 8; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen0);
-			for (sb = 9; sb < 18; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen0);
-			for (sb = 18; sb < 36; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen1);
+			l3_read_scf(maindata_stream, slen0, 8, scf[ch]);
+			l3_read_scf(maindata_stream, slen0, 9, scf[ch] + 9);
+			l3_read_scf(maindata_stream, slen1, 18, scf[ch] + 18);
 		} else {
 			// pure SHORT block
 			cur_ch->part2_len = (slen0 + slen1) * 18;
-			for (sb = 0; sb < 18; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen0);
-			for (sb = 18; sb < 36; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen1);
+			l3_read_scf(maindata_stream, slen0, 18, scf[ch]);
+			l3_read_scf(maindata_stream, slen1, 18, scf[ch] + 18);
 		}
 		scf[ch][36] = scf[ch][37] = scf[ch][38] = 0;
 	} else {
-		// LONG types 0,1,3
+		// LONG types 0,1,3, with scfsi set granule 1 keeps the bands read for this channel in granule 0
 		cur_ch->part2_len = 0;
 		/* Scale factor bands 0-5 */
 		if (!si->scfsi[ch][0] || !gr) {
-			for (sb = 0; sb < 6; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen0);
+			l3_read_scf(maindata_stream, slen0, 6, scf[ch]);
 			cur_ch->part2_len += slen0 * 6;
-		} else {
-			/// Copy scalefactors from granule 0 to granule 1
-			for (sb = 0; sb < 6; ++sb)
-				scf[1][sb] = scf[0][sb];
 		}
 
 		/* Scale factor bands 6-10 */
 		if (!si->scfsi[ch][1] || !gr) {
-			for (sb = 6; sb < 11; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen0);
+			l3_read_scf(maindata_stream, slen0, 5, scf[ch] + 6);
 			cur_ch->part2_len += slen0 * 5;
-		} else {
-			/// Copy scalefactors from granule 0 to granule 1
-			for (sb = 6; sb < 11; ++sb)
-				scf[1][sb] = scf[0][sb];
 		}
 
 		/* Scale factor bands 11-15 */
 		if (!si->scfsi[ch][2] || !gr) {
-			for (sb = 11; sb < 16; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen1);
+			l3_read_scf(maindata_stream, slen1, 5, scf[ch] + 11);
 			cur_ch->part2_len += slen1 * 5;
-		} else {
-			/// Copy scalefactors from granule 0 to granule 1
-			for (sb = 11; sb < 16; ++sb)
-				scf[1][sb] = scf[0][sb];
 		}
 
 		/* Scale factor bands 16-20 */
 		if (!si->scfsi[ch][3] || !gr) {
-			for (sb = 16; sb < 21; ++sb)
-				scf[ch][sb] = bs_readBits(maindata_stream, slen1);
+			l3_read_scf(maindata_stream, slen1, 5, scf[ch] + 16);
 			cur_ch->part2_len += slen1 * 5;
-		} else {
-			/// Copy scalefactors from granule 0 to granule 1
-			for (sb = 16; sb < 21; ++sb)
-				scf[1][sb] = scf[0][sb];
 		}
 		scf[ch][21] = 0;
 	}
 }
 
-static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info* const cur_ch, short is[SBLIMIT * SSLIMIT])
+/*
+* The big_values pairs of a region, is[is_pos] up to end, one function per table class: tables 1 - 15 without linbits,
+* and the linbits families 16 - 23 and 24 - 31, whose tree is fixed. Returns is_pos, -1 for an invalid code.
+*/
+#define L3_HUFFMAN_PAIRS(_Name, _Table, _Treelen, _Linbits) \
+static int _Name(struct bs* const s, const struct huff_tab* const htab, short is[SBLIMIT * SSLIMIT], unsigned is_pos, const unsigned end, int* const part3_len) \
+{ \
+	const uint16_t* const table = (_Table); \
+	const unsigned treelen = (_Treelen); \
+	int len = *part3_len; \
+	unsigned point, bitleft; \
+	short x, y; \
+\
+	(void)htab; \
+	while (is_pos < end) { \
+		bitleft = 32; \
+		point = 0; \
+		while (table[point] & 0xff00) { \
+			if (bs_readBit(s)) { /* goto right-child*/ \
+				while ((table[point] & 0xff) >= 250) \
+					point += table[point] & 0xff; \
+				point += table[point] & 0xff; \
+			} else { /* goto left-child*/ \
+				while ((table[point] >> 8) >= 250) \
+					point += table[point] >> 8; \
+				point += table[point] >> 8; \
+			} \
+			--len; \
+			if (!--bitleft || point >= treelen) { \
+				*part3_len = len; \
+				return -1; \
+			} \
+		} \
+		x = (table[point] >> 4) & 0xf; \
+		y = table[point] & 0xf; \
+\
+		if (x) { \
+			if (_Linbits && x == 15) { \
+				x += bs_readBits(s, htab->linbits); \
+				len -= htab->linbits; \
+			} \
+			if (bs_readBit(s)) \
+				x = -x; \
+			--len; \
+		} \
+		is[is_pos++] = x; \
+\
+		if (y) { \
+			if (_Linbits && y == 15) { \
+				y += bs_readBits(s, htab->linbits); \
+				len -= htab->linbits; \
+			} \
+			if (bs_readBit(s)) \
+				y = -y; \
+			--len; \
+		} \
+		is[is_pos++] = y; \
+	} \
+\
+	*part3_len = len; \
+	return is_pos; \
+}
+
+L3_HUFFMAN_PAIRS(l3_huffman_pairs, htab->table, htab->treelen, 0)
+L3_HUFFMAN_PAIRS(l3_huffman_pairs16, tab16, 511, 1)
+L3_HUFFMAN_PAIRS(l3_huffman_pairs24, tab24, 512, 1)
+
+static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info* const cur_ch, short is[SBLIMIT * SSLIMIT], struct decoder_diag* const diag)
 {
 	unsigned region[3], is_pos = 0;
 	int part3_len = cur_ch->part2_3_len - cur_ch->part2_len;
 	const struct huff_tab* htab;
 	unsigned short point, bitleft, treelen, error = 0, bv = cur_ch->big_values * 2;;
 	short x, y, v, w;
-	char log_msg_buf[64];
 
 	if (part3_len > 0) {
 		struct bs end = { .bit_pos = maindata_stream->bit_pos + part3_len, .byte_ptr = maindata_stream->byte_ptr };
@@ -319,66 +406,29 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 		}
 
 		//  bigvalues 
-		for (int r = 0; r < 3 && !error; ++r) {
-			htab = ht + cur_ch->table_select[r];
-			treelen = htab->treelen;
-			while (is_pos < region[r]/* && part3_len >= 0*/) {
-				{
-					bitleft = 32;
-					error = 1;
-					point = 0;
-					do {
-						if (!(htab->table[point] & 0xff00)) {
-							x = (htab->table[point] >> 4) & 0xf;
-							y = htab->table[point] & 0xf;
-							error = 0;
-							break;
-						}
-
-						if (bs_readBit(maindata_stream)) { /* goto right-child*/
-							while ((htab->table[point] & 0xff) >= 250)
-								point += htab->table[point] & 0xff;
-							point += htab->table[point] & 0xff;
-						} else { /* goto left-child*/
-							while ((htab->table[point] >> 8) >= 250)
-								point += htab->table[point] >> 8;
-							point += htab->table[point] >> 8;
-						}
-						--part3_len;
-					} while (--bitleft && point < treelen/* && part3_len >= 0*/);
-					if (error) {
-						sprintf(log_msg_buf, "bigvalues: bitleft=%hu point=%hu treelen=%hu part3_len=%d", bitleft, point, treelen, part3_len);
-						LOG_E("check_huff_stat", log_msg_buf);
-						break;
-					}
+		for (int r = 0; r < 3; ++r) {
+			const unsigned t = cur_ch->table_select[r];
+			int next;
 
-					if (x) {
-						// get linbits
-						if (htab->linbits && x == 15) {
-							x += bs_readBits(maindata_stream, htab->linbits);
-							part3_len -= htab->linbits;
-						}
-						// get sign bit
-						if (bs_readBit(maindata_stream))
-							x = -x;
-						--part3_len;
-					}
-					is[is_pos++] = x;
-
-					if (y) {
-						// get linbits
-						if (htab->linbits && y == 15) {
-							y += bs_readBits(maindata_stream, htab->linbits);
-							part3_len -= htab->linbits;
-						}
-						// get sign bit
-						if (bs_readBit(maindata_stream))
-							y = -y;
-						--part3_len;
-					}
-					is[is_pos++] = y;
-				}
+			if (is_pos >= region[r])
+				continue;
+			// tables 0, 4 and 14 have no codes, the region is all zeros
+			if (!ht[t].treelen) {
+				memset(is + is_pos, 0, (region[r] - is_pos) * sizeof(short));
+				is_pos = region[r];
+				continue;
+			}
+			if (t < 16)
+				next = l3_huffman_pairs(maindata_stream, ht + t, is, is_pos, region[r], &part3_len);
+			else if (t < 24)
+				next = l3_huffman_pairs16(maindata_stream, ht + t, is, is_pos, region[r], &part3_len);
+			else next = l3_huffman_pairs24(maindata_stream, ht + t, is, is_pos, region[r], &part3_len);
+			if (next < 0) {
+				diag_Raise(diag, DIAG_HUFF_BIG_VALUES);
+				error = 1;
+				break;
 			}
+			is_pos = next;
 		}
 
 		//  count1 
@@ -409,10 +459,8 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 				--part3_len;
 			} while (--bitleft && point < treelen/* && part3_len >= 0*/);
 			if (error) {
-				if (part3_len < -1) {
-					sprintf(log_msg_buf, "count1: bitleft=%hu point=%hu treelen=%hu part3_len=%d", bitleft, point, treelen, part3_len);
-					LOG_E("check_huff_stat", log_msg_buf);
-				}
+				if (part3_len < -1)
+					diag_Raise(diag, DIAG_HUFF_COUNT1);
 				break;
 			}
 
@@ -425,7 +473,7 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 				if (bs_readBit(maindata_stream))
 					x = -x;
 				if (--part3_len < 0) {
-					LOG_E("check_huff_stat", "count1: x");
+					diag_Raise(diag, DIAG_HUFF_COUNT1);
 					//break;
 				}
 			}
@@ -434,7 +482,7 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 				if (bs_readBit(maindata_stream))
 					v = -v;
 				if (--part3_len < 0) {
-					LOG_E("check_huff_stat", "count1: v");
+					diag_Raise(diag, DIAG_HUFF_COUNT1);
 					//break;
 				}
 			}
@@ -443,7 +491,7 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 				if (bs_readBit(maindata_stream))
 					w = -w;
 				if (--part3_len < 0) {
-					LOG_E("check_huff_stat", "count1: w");
+					diag_Raise(diag, DIAG_HUFF_COUNT1);
 					//break;
 				}
 			}
@@ -452,7 +500,7 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 				if (bs_readBit(maindata_stream))
 					y = -y;
 				if (--part3_len < 0) {
-					LOG_E("check_huff_stat", "count1: y");
+					diag_Raise(diag, DIAG_HUFF_COUNT1);
 					//break;
 				}
 			}
@@ -472,9 +520,9 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 		if (part3_len < 0) {
 			if (part3_len + 1 < 0)
 				is_pos -= 4;
-			LOG_E("check_huff_stat", "part3_len < 0");
+			diag_Raise(diag, DIAG_PART3_OVERRUN);
 		} else if (part3_len > 0) {
-			LOG_E("check_huff_stat", "part3_len > 0");
+			diag_Raise(diag, DIAG_PART3_UNDERRUN);
 		}
 
 		maindata_stream->byte_ptr = end.byte_ptr;
@@ -485,6 +533,22 @@ static void l3_huffman_decode(struct bs* const maindata_stream, struct ch_info*
 
 	while (is_pos < 576)
 		is[is_pos++] = 0;
+
+	/*
+	* nonzero_len bounds the back end, so it covers where the values end up: short blocks are reordered by
+	* window, which spreads the last band over all of its three windows, and the antialias butterflies
+	* of long blocks reach into the subband after the last one with values.
+	*/
+	if (cur_ch->win_switch_flag && cur_ch->block_type == 2 && cur_ch->nonzero_len > (cur_ch->mixed_block_flag ? 36u : 0u)) {
+		int sfb = cur_ch->mixed_block_flag ? 3 : 0;
+		while (cur_sfb_table.index_short[sfb + 1] < cur_ch->nonzero_len)
+			++sfb;
+		cur_ch->nonzero_len = cur_sfb_table.index_short[sfb + 1];
+	} else if (cur_ch->nonzero_len && !(cur_ch->win_switch_flag && cur_ch->block_type == 2)) {
+		cur_ch->nonzero_len = ((cur_ch->nonzero_len + SSLIMIT - 1) / SSLIMIT + 1) * SSLIMIT;
+		if (cur_ch->nonzero_len > SBLIMIT * SSLIMIT)
+			cur_ch->nonzero_len = SBLIMIT * SSLIMIT;
+	}
 }
 
 //static void l3_requantize_long(const struct ch_info* const cur_ch, const int sfb, const int pos, const short is[SBLIMIT * SSLIMIT], float xr[SBLIMIT * SSLIMIT])
@@ -593,168 +657,242 @@ static void l3_requantize(const struct ch_info* cur_ch, const struct mpeg_frame*
 		xr[is_pos++] = 0.0f;
 }
 
-static void l3_do_ms_stereo(const unsigned max, float xr[2][SBLIMIT * SSLIMIT])
+// xr[0] = M + S, xr[1] = M - S for n lines from pos, M: xr[0], S: requantized from v with the gain g
+static void l3_ms_lines(const short* const v, const float g, const unsigned pos, const unsigned n, float xr[2][SBLIMIT * SSLIMIT])
 {
-	for (unsigned i = 0; i < max; i += 4) {
-		__m128 f4_0 = _mm_loadu_ps(&xr[0][i]), f4_1 = _mm_loadu_ps(&xr[1][i]);
-		_mm_storeu_ps(&xr[0][i], _mm_add_ps(f4_0, f4_1));
-		_mm_storeu_ps(&xr[1][i], _mm_sub_ps(f4_0, f4_1));
+	const __m128 g4 = _mm_set1_ps(g);
+	unsigned i = 0;
+
+#define POWIS(_V) ((_V) < 0 ? -gain_powis[-(_V)] : gain_powis[(_V)])
+	for (; i + 4 <= n; i += 4) {
+		const __m128 s = _mm_mul_ps(g4, _mm_setr_ps(POWIS(v[i]), POWIS(v[i + 1]), POWIS(v[i + 2]), POWIS(v[i + 3])));
+		const __m128 m = _mm_loadu_ps(&xr[0][pos + i]);
+		_mm_storeu_ps(&xr[0][pos + i], _mm_add_ps(m, s));
+		_mm_storeu_ps(&xr[1][pos + i], _mm_sub_ps(m, s));
+	}
+	for (; i < n; ++i) {
+		const float m = xr[0][pos + i], s = g * POWIS(v[i]);
+		xr[0][pos + i] = m + s;
+		xr[1][pos + i] = m - s;
 	}
+#undef POWIS
 }
 
-static void l3_do_intesity_stereo(struct gr_info* cur_gr, const unsigned scf[39], float xr[2][SBLIMIT * SSLIMIT])
+/*
+* l3_requantize of the side channel with the M/S reconstruction fused in, for M/S without intensity stereo:
+* xr[0] holds the requantized mid channel and both get L = M + S, R = M - S while S is still in registers,
+* instead of a l3_do_ms_stereo pass over both channels. The 1/sqrt(2) is in the gain as with l3_requantize.
+*/
+static void l3_requantize_ms(const struct ch_info* cur_ch, const short is[SBLIMIT * SSLIMIT], const unsigned scf[39], float xr[2][SBLIMIT * SSLIMIT])
 {
-	int sfb, is_possb, width, sfb_start, sfb_stop, i, window;
-	double is_ratio_l, is_ratio_r;
+	unsigned is_pos = 0, pow2i = 255 - cur_ch->global_gain + 2, sfb = 0, window, width, xri_start = 0, xri = 0, bi, shift = cur_ch->scalefac_scale + 1;
+	const unsigned char* pre = pretab[cur_ch->preflag];
 
-	if (cur_gr->ch[0].mixed_block_flag != cur_gr->ch[1].mixed_block_flag || cur_gr->ch[0].block_type != cur_gr->ch[1].block_type) {
-		LOG_W("check_stereo", "bad stereo!");
+	if (!cur_ch->nonzero_len) {
+		// S == 0
+		memcpy(xr[1], xr[0], sizeof(xr[1]));
 		return;
 	}
 
-	if (cur_gr->ch[0].win_switch_flag && cur_gr->ch[0].block_type == 2) {
-		// MPEG-1, short block/mixed block
-		if (cur_gr->ch[0].mixed_block_flag) {
-			for (sfb = 0; sfb < 8; ++sfb) {
-				if (cur_sfb_table.index_long[sfb] < cur_gr->ch[1].nonzero_len)
-					continue;
-				if ((is_possb = scf[sfb]) == 7)
-					continue;
-				sfb_start = cur_sfb_table.index_long[sfb];
-				sfb_stop = cur_sfb_table.index_long[sfb + 1];
-				if (is_possb == 6) {
-					is_ratio_l = 1.0;
-					is_ratio_r = 0.0;
-				} else {
-					is_ratio_l = is_ratio[is_possb] / (1.0 + is_ratio[is_possb]);
-					is_ratio_r = 1.0 / (1.0 + is_ratio[is_possb]);
-				}
-				for (i = sfb_start; i < sfb_stop; ++i) {
-					xr[0][i] *= (float)is_ratio_l;
-					xr[1][i] *= (float)is_ratio_r;
-				}
-			}
-
-			for (sfb = 3; sfb < 12; ++sfb) {
-				if (cur_sfb_table.index_short[sfb] < cur_gr->ch[1].nonzero_len)
-					continue;
-				width = cur_sfb_table.width_short[sfb];
-				for (window = 0; window < 3; ++window) {
-					if ((is_possb = scf[sfb * 3 + window]) == 7)
-						continue;
-					sfb_start = cur_sfb_table.index_short[sfb] + width * window;
-					sfb_stop = sfb_start + width;
-					if (is_possb == 6) {
-						is_ratio_l = 1.0;
-						is_ratio_r = 0.0;
-					} else {
-						is_ratio_l = is_ratio[is_possb] / (1.0 + is_ratio[is_possb]);
-						is_ratio_r = 1.0 / (1.0 + is_ratio[is_possb]);
-					}
-					for (i = sfb_start; i < sfb_stop; ++i) {
-						xr[0][i] *= (float)is_ratio_l;
-						xr[1][i] *= (float)is_ratio_r;
-					}
-				}
+	if (cur_ch->win_switch_flag && cur_ch->block_type == 2) {
+		if (cur_ch->mixed_block_flag) {
+			for (; sfb < 8; ++sfb, ++scf, ++pre) {
+				width = cur_sfb_table.width_long[sfb];
+				l3_ms_lines(is + is_pos, gain_pow2[pow2i + ((*scf + *pre) << shift)], is_pos, width, xr);
+				is_pos += width;
 			}
-		} else {
-			for (sfb = 0; sfb < 12; ++sfb) {
-				if (cur_sfb_table.index_short[sfb] < cur_gr->ch[1].nonzero_len)
-					continue;
-				width = cur_sfb_table.width_short[sfb];
-				for (window = 0; window < 3; ++window) {
-					if ((is_possb = scf[sfb * 3 + window]) == 7)
-						continue;
-					sfb_start = cur_sfb_table.index_short[sfb] + width * window;
-					sfb_stop = sfb_start + width;
-					if (is_possb == 6) {
-						is_ratio_l = 1.0;
-						is_ratio_r = 0.0;
-					} else {
-						is_ratio_l = is_ratio[is_possb] / (1.0 + is_ratio[is_possb]);
-						is_ratio_r = 1.0 / (1.0 + is_ratio[is_possb]);
-					}
-					for (i = sfb_start; i < sfb_stop; ++i) {
-						xr[0][i] *= (float)is_ratio_l;
-						xr[1][i] *= (float)is_ratio_r;
-					}
+			++scf;
+			xri_start = 36;
+			sfb = 3;
+		}
+		// the reordered lines of a window are 3 apart
+		for (; is_pos < SBLIMIT * SSLIMIT; ++sfb) {
+			width = cur_sfb_table.width_short[sfb];
+			for (window = 0; window < 3; ++window, ++scf) {
+				const float g = gain_pow2[pow2i + cur_ch->subblock_gain[window] * 8 + (*scf << shift)];
+				xri = xri_start + window;
+				for (bi = 0; bi < width; ++bi, ++is_pos, xri += 3) {
+					const float m = xr[0][xri], s = is[is_pos] < 0 ? -g * gain_powis[-is[is_pos]] : g * gain_powis[is[is_pos]];
+					xr[0][xri] = m + s;
+					xr[1][xri] = m - s;
 				}
 			}
+			xri_start = xri - 2;
 		}
 	} else {
-		// MPEG-1, long block
-		for (sfb = 0; sfb < 21; ++sfb) {
-			if (cur_sfb_table.index_long[sfb] < cur_gr->ch[1].nonzero_len)
-				continue;
-			if ((is_possb = scf[sfb]) == 7)
+		for (; is_pos < SBLIMIT * SSLIMIT; ++sfb, ++scf, ++pre) {
+			width = cur_sfb_table.width_long[sfb];
+			l3_ms_lines(is + is_pos, gain_pow2[pow2i + ((*scf + *pre) << shift)], is_pos, width, xr);
+			is_pos += width;
+		}
+	}
+}
+
+static void l3_do_ms_stereo(const unsigned max, float xr[2][SBLIMIT * SSLIMIT])
+{
+	for (unsigned i = 0; i < max; i += 4) {
+		__m128 f4_0 = _mm_loadu_ps(&xr[0][i]), f4_1 = _mm_loadu_ps(&xr[1][i]);
+		_mm_storeu_ps(&xr[0][i], _mm_add_ps(f4_0, f4_1));
+		_mm_storeu_ps(&xr[1][i], _mm_sub_ps(f4_0, f4_1));
+	}
+}
+
+/*
+* The intensity stereo bands are the ones above the last nonzero value of the right channel, for short blocks
+* per window. bound[0 - 2]: the first short sfb of each window in the I/S part, bound[3]: the first long sfb,
+* 8 for mixed blocks with values in the short part of the right channel.
+*/
+static void l3_is_bounds(const struct ch_info* const ch1, const short is[SBLIMIT * SSLIMIT], unsigned bound[4])
+{
+	unsigned n = ch1->nonzero_len < SBLIMIT * SSLIMIT ? ch1->nonzero_len : SBLIMIT * SSLIMIT, found = 0, sfb, window, i;
+
+	if (ch1->win_switch_flag && ch1->block_type == 2) {
+		const unsigned first = ch1->mixed_block_flag ? 3 : 0;
+
+		bound[0] = bound[1] = bound[2] = first;
+		// is[] is in the decoded order, the windows of a band one after the other
+		for (sfb = 13; sfb-- > first && found != 7;) {
+			const unsigned width = cur_sfb_table.width_short[sfb];
+			if (cur_sfb_table.index_short[sfb] >= n)
 				continue;
-			sfb_start = cur_sfb_table.index_long[sfb];
-			sfb_stop = cur_sfb_table.index_long[sfb + 1];
-			if (is_possb == 6) {
-				is_ratio_l = 1.0;
-				is_ratio_r = 0.0;
-			} else {
-				is_ratio_l = is_ratio[is_possb] / (1.0 + is_ratio[is_possb]);
-				is_ratio_r = 1.0 / (1.0 + is_ratio[is_possb]);
-			}
-			for (i = sfb_start; i < sfb_stop; ++i) {
-				xr[0][i] *= (float)is_ratio_l;
-				xr[1][i] *= (float)is_ratio_r;
+			for (window = 0; window < 3; ++window) {
+				const short* const v = is + cur_sfb_table.index_short[sfb] + width * window;
+				if (found & 1 << window)
+					continue;
+				for (i = 0; i < width && !v[i]; ++i)
+					;
+				if (i < width) {
+					bound[window] = sfb + 1;
+					found |= 1 << window;
+				}
 			}
 		}
+		if (!ch1->mixed_block_flag || found) {
+			bound[3] = 8;
+			return;
+		}
+		n = 36;
+	}
+
+	while (n && !is[n - 1])
+		--n;
+	for (sfb = 0; cur_sfb_table.index_long[sfb] < n; ++sfb)
+		;
+	bound[3] = sfb;
+}
+
+/*
+* L = x0 * c[0] + x1 * c[1], R = x0 * c[2] + x1 * c[3] over the lines [i, end) of a band,
+* c[window] repeats every 3 lines for the windows of the reordered short bands, long bands pass 3 equal rows
+*/
+static void l3_stereo_band(unsigned i, const unsigned end, const float c[3][4], float xr[2][SBLIMIT * SSLIMIT])
+{
+	__m128 k[3][4];
+	unsigned p, j;
+
+	// the vector at line 4 * m of the band starts in window m % 3
+	for (p = 0; p < 3; ++p) {
+		for (j = 0; j < 4; ++j)
+			k[p][j] = _mm_setr_ps(c[p][j], c[(p + 1) % 3][j], c[(p + 2) % 3][j], c[p][j]);
+	}
+
+	for (p = 0; i + 4 <= end; i += 4, p = p == 2 ? 0 : p + 1) {
+		const __m128 x0 = _mm_loadu_ps(&xr[0][i]), x1 = _mm_loadu_ps(&xr[1][i]);
+		_mm_storeu_ps(&xr[0][i], _mm_add_ps(_mm_mul_ps(x0, k[p][0]), _mm_mul_ps(x1, k[p][1])));
+		_mm_storeu_ps(&xr[1][i], _mm_add_ps(_mm_mul_ps(x0, k[p][2]), _mm_mul_ps(x1, k[p][3])));
+	}
+	for (; i < end; ++i, p = p == 2 ? 0 : p + 1) {
+		const float x0 = xr[0][i], x1 = xr[1][i];
+		xr[0][i] = x0 * c[p][0] + x1 * c[p][1];
+		xr[1][i] = x0 * c[p][2] + x1 * c[p][3];
 	}
 }
 
-static void l3_antialias(const struct ch_info* cur_ch, float xr[SBLIMIT * SSLIMIT])
+/*
+* M/S and intensity stereo in one pass over the bands: below the I/S bound and in bands with is_pos >= 7 M/S
+* (or nothing), above it both channels from the left one. scf: the right channel's scalefactors,
+* the last long and short band take the is_pos of the one before.
+*/
+static void l3_do_stereo(const struct gr_info* const cur_gr, const struct mpeg_frame* const frame, const unsigned scf[39], const unsigned bound[4], float xr[2][SBLIMIT * SSLIMIT], struct decoder_diag* const diag)
 {
-	int sblimit, sb;
-	float tmp[4];
+	static const float c_lr[4] = { 1.0f, 0.0f, 0.0f, 1.0f }, c_ms[4] = { 1.0f, 1.0f, 1.0f, -1.0f };
+	const struct ch_info* const ch1 = &cur_gr->ch[1];
+	const unsigned nz = cur_gr->ch[0].nonzero_len;
+	const int is_short = ch1->win_switch_flag && ch1->block_type == 2;
+	const unsigned long_sfbs = is_short ? (ch1->mixed_block_flag ? 8 : 0) : 22;
+	const float* const c_plain = frame->is_MS ? c_ms : c_lr;
+	float c[3][4];
+	unsigned sfb, window, start, end, is_pos;
+
+	if (!frame->is_Intensity || cur_gr->ch[0].block_type != ch1->block_type || cur_gr->ch[0].mixed_block_flag != ch1->mixed_block_flag) {
+		if (frame->is_Intensity)
+			diag_Raise(diag, DIAG_BAD_STEREO);
+		if (frame->is_MS)
+			l3_do_ms_stereo(nz, xr);
+		return;
+	}
 
-	if (cur_ch->win_switch_flag && cur_ch->block_type == 2) {
-		if (!cur_ch->mixed_block_flag)
-			return;
-		sblimit = SSLIMIT;
-	} else
-		sblimit = /*SBLIMIT * SSLIMIT*/ cur_ch->nonzero_len - SSLIMIT;
+	for (window = 0; window < 3; ++window)
+		memcpy(c[window], c_plain, sizeof(c[0]));
+	if (frame->is_MS) {
+		end = cur_sfb_table.index_long[bound[3] < long_sfbs ? bound[3] : long_sfbs];
+		l3_stereo_band(0, end < nz ? end : nz, c, xr);
+	}
 
-	for (sb = 0; sb < sblimit; sb += SSLIMIT) {
-		__m128 f4_xr0 = _mm_setr_ps(xr[sb + 17], xr[sb + 16], xr[sb + 15], xr[sb + 14]), f4_xr1 = _mm_loadu_ps(&xr[sb + 18]);
-		__m128 f4_cs = _mm_loadu_ps(cs), f4_ca = _mm_loadu_ps(ca);
+	for (sfb = bound[3]; sfb < long_sfbs && (start = cur_sfb_table.index_long[sfb]) < nz; ++sfb) {
+		end = cur_sfb_table.index_long[sfb + 1];
+		if ((is_pos = scf[sfb < 21 ? sfb : 20]) >= 7 && !frame->is_MS)
+			continue;
+		for (window = 0; window < 3; ++window) {
+			if (is_pos >= 7) {
+				memcpy(c[window], c_ms, sizeof(c[0]));
+			} else {
+				c[window][0] = is_lr[frame->is_MS][is_pos][0];
+				c[window][2] = is_lr[frame->is_MS][is_pos][1];
+				c[window][1] = c[window][3] = 0.0f;
+			}
+		}
+		l3_stereo_band(start, end < nz ? end : nz, c, xr);
+	}
 
-		_mm_storeu_ps(tmp, _mm_sub_ps(_mm_mul_ps(f4_xr0, f4_cs), _mm_mul_ps(f4_xr1, f4_ca)));
-		xr[sb + 17] = tmp[0];
-		xr[sb + 16] = tmp[1];
-		xr[sb + 15] = tmp[2];
-		xr[sb + 14] = tmp[3];
-		_mm_storeu_ps(&xr[sb + 18], _mm_sub_ps(_mm_mul_ps(f4_xr1, f4_cs), _mm_mul_ps(f4_xr0, f4_ca)));
-
-		f4_xr0 = _mm_setr_ps(xr[sb + 13], xr[sb + 12], xr[sb + 11], xr[sb + 10]), f4_xr1 = _mm_loadu_ps(&xr[sb + 22]);
-		f4_cs = _mm_loadu_ps(cs + 4), f4_ca = _mm_loadu_ps(ca + 4);
-		_mm_storeu_ps(tmp, _mm_sub_ps(_mm_mul_ps(f4_xr0, f4_cs), _mm_mul_ps(f4_xr1, f4_ca)));
-		xr[sb + 13] = tmp[0];
-		xr[sb + 12] = tmp[1];
-		xr[sb + 11] = tmp[2];
-		xr[sb + 10] = tmp[3];
-		_mm_storeu_ps(&xr[sb + 22], _mm_sub_ps(_mm_mul_ps(f4_xr1, f4_cs), _mm_mul_ps(f4_xr0, f4_ca)));
+	if (!is_short)
+		return;
+	for (sfb = ch1->mixed_block_flag ? 3 : 0; sfb < 13 && (start = cur_sfb_table.index_short[sfb]) < nz; ++sfb) {
+		int active = frame->is_MS;
+
+		end = cur_sfb_table.index_short[sfb + 1];
+		for (window = 0; window < 3; ++window) {
+			if (sfb < bound[window] || (is_pos = scf[(sfb < 12 ? sfb : 11) * 3 + window]) >= 7) {
+				memcpy(c[window], c_plain, sizeof(c[0]));
+			} else {
+				c[window][0] = is_lr[frame->is_MS][is_pos][0];
+				c[window][2] = is_lr[frame->is_MS][is_pos][1];
+				c[window][1] = c[window][3] = 0.0f;
+				active = 1;
+			}
+		}
+		if (active)
+			l3_stereo_band(start, end < nz ? end : nz, c, xr);
 	}
 }
 
-static void imdct12(const float xr[SSLIMIT], float rawout[36])
+// the three windows overlap by half, the first and last 6 values are 0
+static void imdct12(const float xr[SSLIMIT], float rawout[36], const float window[36])
 {
 	float f_sum[4];
+	memset(rawout, 0, 36 * sizeof(float));
 	for (int i = 0; i < 3; ++i) {
 		__m128 f4_xr0 = _mm_setr_ps(xr[i], xr[i + 3], xr[i + 6], xr[i + 9]), f4_xr1 = _mm_setr_ps(xr[i + 12], xr[i + 15], 0, 0);
 		for (int j = 0; j < 12; ++j) {
 			__m128 f4_sum = _mm_mul_ps(f4_xr0, _mm_setr_ps(imdct_s[0][j], imdct_s[1][j], imdct_s[2][j], imdct_s[3][j]));
 			f4_sum = _mm_add_ps(f4_sum, _mm_mul_ps(f4_xr1, _mm_setr_ps(imdct_s[4][j], imdct_s[5][j], 0, 0)));
-			//f4_sum = _mm_mul_ps(f4_sum, _mm_set1_ps(imdct_window[2][j]));
 			_mm_storeu_ps(f_sum, f4_sum);
-			rawout[6 * i + j + 6] = (f_sum[0] + f_sum[1] + f_sum[2] + f_sum[3]) * imdct_window[2][j];
+			rawout[6 * i + j + 6] += (f_sum[0] + f_sum[1] + f_sum[2] + f_sum[3]) * window[j];
 		}
 	}
 }
 
-static void imdct36(const float xr[SSLIMIT], float rawout[36], unsigned char block_type)
+static void imdct36(const float xr[SSLIMIT], float rawout[36], const float window[36])
 {
 	float f_sum[4];
 	for (int i = 0; i < 36; ++i) {
@@ -764,37 +902,300 @@ static void imdct36(const float xr[SSLIMIT], float rawout[36], unsigned char blo
 		f4_sum = _mm_add_ps(f4_sum, _mm_mul_ps(f4_xr2, _mm_setr_ps(imdct_l[8][i], imdct_l[9][i], imdct_l[10][i], imdct_l[11][i])));
 		f4_sum = _mm_add_ps(f4_sum, _mm_mul_ps(f4_xr3, _mm_setr_ps(imdct_l[12][i], imdct_l[13][i], imdct_l[14][i], imdct_l[15][i])));
 		f4_sum = _mm_add_ps(f4_sum, _mm_mul_ps(f4_xr4, _mm_setr_ps(imdct_l[16][i], imdct_l[17][i], 0, 0)));
-		//f4_sum = _mm_mul_ps(f4_sum, _mm_set1_ps(imdct_window[block_type][i]));
 		_mm_storeu_ps(f_sum, f4_sum);
-		rawout[i] = (f_sum[0] + f_sum[1] + f_sum[2] + f_sum[3]) * imdct_window[block_type][i];
+		rawout[i] = (f_sum[0] + f_sum[1] + f_sum[2] + f_sum[3]) * window[i];
 	}
 }
 
-static void l3_hybrid(const struct ch_info* cur_ch, const int ch, float xr[SBLIMIT * SSLIMIT])
+// the 8 butterflies between the upper end of x[0 - 17] and the next subband in x[18 - 25]
+static void l3_antialias_pair(float x[SSLIMIT + 8])
 {
-	float rawout[36];
-	unsigned off, i;
+	float tmp[4];
 
-	for (off = 0; off < /*SBLIMIT * SSLIMIT*/ cur_ch->nonzero_len; off += SSLIMIT) {
-		unsigned char block_type = (cur_ch->win_switch_flag && cur_ch->mixed_block_flag && off < 2 * SSLIMIT) ? 0 : cur_ch->block_type;
+	for (int i = 0; i < 8; i += 4) {
+		const __m128 f4_xr0 = _mm_setr_ps(x[17 - i], x[16 - i], x[15 - i], x[14 - i]), f4_xr1 = _mm_loadu_ps(&x[18 + i]);
+		const __m128 f4_cs = _mm_loadu_ps(cs + i), f4_ca = _mm_loadu_ps(ca + i);
+
+		_mm_storeu_ps(tmp, _mm_sub_ps(_mm_mul_ps(f4_xr0, f4_cs), _mm_mul_ps(f4_xr1, f4_ca)));
+		x[17 - i] = tmp[0];
+		x[16 - i] = tmp[1];
+		x[15 - i] = tmp[2];
+		x[14 - i] = tmp[3];
+		_mm_storeu_ps(&x[18 + i], _mm_add_ps(_mm_mul_ps(f4_xr1, f4_cs), _mm_mul_ps(f4_xr0, f4_ca)));
+	}
+}
+
+/*
+* The hybrid filter bank one subband at a time: antialias, IMDCT with windowing, overlap-add and frequency inversion.
+* Every line is read and written once, the subband goes to a local copy together with the first 8 lines of the next one
+* for the butterflies, and those 8 are carried over. The odd subbands take the sign-flipped windows, so their output
+* and overlap come out inverted. The output goes to out[ss][sb], in the order the synthesis reads it.
+*/
+static void l3_hybrid(const struct ch_info* cur_ch, const int ch, const float xr[SBLIMIT * SSLIMIT], float out[SSLIMIT][SBLIMIT])
+{
+	const unsigned len = cur_ch->nonzero_len < hybrid_len ? cur_ch->nonzero_len : hybrid_len;
+	const int is_short = cur_ch->win_switch_flag && cur_ch->block_type == 2;
+	// the butterflies run between subband sb and sb + 1 for sb < aa_bands: none for short blocks, the long part
+	// of mixed ones, for long blocks up to the last subband with values (nonzero_len of the other channel may be a short one's)
+	const unsigned aa_lines = cur_ch->nonzero_len > SSLIMIT ? (len < cur_ch->nonzero_len - SSLIMIT ? len : cur_ch->nonzero_len - SSLIMIT) : 0;
+	const unsigned aa_bands = is_short ? (cur_ch->mixed_block_flag ? 1 : 0) : (aa_lines + SSLIMIT - 1) / SSLIMIT;
+	float* const prev = overlapp[ch];
+	float x[SSLIMIT + 8], rawout[36];
+	unsigned sb, off, i;
+
+	for (sb = 0, off = 0; off < len; ++sb, off += SSLIMIT) {
+		const unsigned char block_type = (cur_ch->win_switch_flag && cur_ch->mixed_block_flag && sb < 2) ? 0 : cur_ch->block_type;
+		const float* const window = (sb & 1 ? imdct_window_inv : imdct_window)[block_type];
+
+		if (sb && sb <= aa_bands) {
+			memcpy(x, x + SSLIMIT, 8 * sizeof(float));
+			memcpy(x + 8, xr + off + 8, (SSLIMIT - 8) * sizeof(float));
+		} else memcpy(x, xr + off, SSLIMIT * sizeof(float));
+		if (sb < aa_bands) {
+			memcpy(x + SSLIMIT, xr + off + SSLIMIT, 8 * sizeof(float));
+			l3_antialias_pair(x);
+		}
 
-		/* IMDCT and WINDOWING */
 		if (block_type == 2)
-			imdct12(xr + off, rawout);
-		else
-			imdct36(xr + off, rawout, block_type);
+			imdct12(x, rawout, window);
+		else imdct36(x, rawout, window);
+
+		for (i = 0; i < SSLIMIT; ++i) {
+			out[i][sb] = rawout[i] + prev[off + i];
+			prev[off + i] = rawout[i + SSLIMIT];
+		}
+	}
 
-		/* OVERLAPPING */
+	// past nonzero_len the output is the overlap, already inverted
+	for (; off < hybrid_len; ++sb, off += SSLIMIT) {
 		for (i = 0; i < SSLIMIT; ++i) {
-			xr[off + i] = rawout[i] + overlapp[ch][off + i];
-			overlapp[ch][off + i] = rawout[i + SSLIMIT];
+			out[i][sb] = prev[off + i];
+			prev[off + i] = 0.0f;
+		}
+	}
+}
+
+/*
+* Stereo to mono ahead of the back end: antialias, IMDCT and synthesis are linear, so when both channels
+* share the block layout the average spectrum goes through channel 0's back end alone.
+* Otherwise both hybrids run on halved spectra and are summed, and channel 1's overlap is folded into
+* channel 0's, which keeps the shared path valid for the next granule.
+*/
+static void l3_downmix(struct gr_info* const cur_gr, float xr[2][SBLIMIT * SSLIMIT], struct decoder_profile* const prof)
+{
+	struct ch_info* const ch0 = &cur_gr->ch[0], * const ch1 = &cur_gr->ch[1];
+	const __m128 f4_half = _mm_set1_ps(0.5f);
+	unsigned i;
+	(void)prof;	// only the PROFILE_ macros use it
+
+	// the short block reordering can put values past nonzero_len, so the mix covers the whole granule
+	if (ch0->nonzero_len < ch1->nonzero_len)
+		ch0->nonzero_len = ch1->nonzero_len;
+	else ch1->nonzero_len = ch0->nonzero_len;
+
+	if (ch0->block_type == ch1->block_type && ch0->mixed_block_flag == ch1->mixed_block_flag) {
+		PROFILE_BEGIN(t_mix);
+		for (i = 0; i < SBLIMIT * SSLIMIT; i += 4)
+			_mm_storeu_ps(&xr[0][i], _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(&xr[0][i]), _mm_loadu_ps(&xr[1][i])), f4_half));
+		PROFILE_END(prof, PROFILE_STEREO, t_mix);
+
+		PROFILE_BEGIN(t_hyb);
+		l3_hybrid(ch0, 0, xr[0], hybrid_out[0]);
+		PROFILE_END(prof, PROFILE_HYBRID, t_hyb);
+	} else {
+		PROFILE_BEGIN(t_scale);
+		for (i = 0; i < SBLIMIT * SSLIMIT; i += 4) {
+			_mm_storeu_ps(&xr[0][i], _mm_mul_ps(_mm_loadu_ps(&xr[0][i]), f4_half));
+			_mm_storeu_ps(&xr[1][i], _mm_mul_ps(_mm_loadu_ps(&xr[1][i]), f4_half));
+		}
+		PROFILE_END(prof, PROFILE_STEREO, t_scale);
+
+		PROFILE_BEGIN(t_hyb);
+		l3_hybrid(ch0, 0, xr[0], hybrid_out[0]);
+		l3_hybrid(ch1, 1, xr[1], hybrid_out[1]);
+		PROFILE_END(prof, PROFILE_HYBRID, t_hyb);
+
+		// past nonzero_len the hybrid output is the previous overlap
+		PROFILE_BEGIN(t_mix);
+		for (i = 0; i < SBLIMIT * SSLIMIT; i += 4) {
+			_mm_store_ps(&hybrid_out[0][0][i], _mm_add_ps(_mm_load_ps(&hybrid_out[0][0][i]), _mm_load_ps(&hybrid_out[1][0][i])));
+			_mm_storeu_ps(&overlapp[0][i], _mm_add_ps(_mm_loadu_ps(&overlapp[0][i]), _mm_loadu_ps(&overlapp[1][i])));
+			_mm_storeu_ps(&overlapp[1][i], _mm_setzero_ps());
+		}
+		PROFILE_END(prof, PROFILE_STEREO, t_mix);
+	}
+}
+
+/*
+* Reference path (DECODE_REFERENCE): requantization, stereo processing, antialias, IMDCT, overlap and
+* synthesis with the formulas of the float path, in double precision and without SIMD,
+* always over the whole granule instead of up to nonzero_len. Only a measure for the float path, see accuracy.h.
+*/
+static double xr_ref[2][SBLIMIT * SSLIMIT];
+
+static double l3_requantize_value_ref(const unsigned pow2i, const short v)
+{
+	if (v < 0)
+		return -gain_pow2_ref[pow2i] * gain_powis_ref[-v];
+	return v ? gain_pow2_ref[pow2i] * gain_powis_ref[v] : 0.0;
+}
+
+static void l3_requantize_ref(const struct ch_info* cur_ch, const struct mpeg_frame* frame, const short is[SBLIMIT * SSLIMIT], const unsigned scf[39], double xr[SBLIMIT * SSLIMIT])
+{
+	unsigned is_pos = 0, pow2i = 255 - cur_ch->global_gain, sfb = 0, window, width, xri_start = 0, xri = 0, bi, shift = cur_ch->scalefac_scale + 1;
+	const unsigned char* pre = pretab[cur_ch->preflag];
+
+	if (frame->is_MS)
+		pow2i += 2;
+
+	memset(xr, 0, SBLIMIT * SSLIMIT * sizeof(double));
+	if (!cur_ch->nonzero_len)
+		return;
+
+	if (cur_ch->win_switch_flag && cur_ch->block_type == 2) {
+		if (cur_ch->mixed_block_flag) {
+			for (; sfb < 8; ++sfb, ++scf, ++pre) {
+				width = cur_sfb_table.width_long[sfb];
+				for (bi = 0; bi < width; ++bi, ++is_pos)
+					xr[is_pos] = l3_requantize_value_ref(pow2i + ((*scf + *pre) << shift), is[is_pos]);
+			}
+			++scf;
+			xri_start = 36;
+			sfb = 3;
+		}
+		for (; is_pos < SBLIMIT * SSLIMIT; ++sfb) {
+			width = cur_sfb_table.width_short[sfb];
+			for (window = 0; window < 3; ++window, ++scf) {
+				xri = xri_start + window;
+				for (bi = 0; bi < width; ++bi, ++is_pos, xri += 3)
+					xr[xri] = l3_requantize_value_ref(pow2i + cur_ch->subblock_gain[window] * 8 + (*scf << shift), is[is_pos]);
+			}
+			xri_start = xri - 2;
+		}
+	} else {
+		for (; is_pos < SBLIMIT * SSLIMIT; ++sfb, ++scf, ++pre) {
+			width = cur_sfb_table.width_long[sfb];
+			for (bi = 0; bi < width; ++bi, ++is_pos)
+				xr[is_pos] = l3_requantize_value_ref(pow2i + ((*scf + *pre) << shift), is[is_pos]);
 		}
 	}
+}
+
+// the is_pos of line i of the reordered granule, 7 below the I/S bound (see l3_is_bounds), 7 and up are not I/S
+static unsigned l3_is_pos_ref(const struct ch_info* const ch1, const unsigned scf[39], const unsigned bound[4], const unsigned i)
+{
+	unsigned sfb = 0;
+
+	if (ch1->win_switch_flag && ch1->block_type == 2 && (!ch1->mixed_block_flag || i >= 36)) {
+		while (cur_sfb_table.index_short[sfb + 1] <= i)
+			++sfb;
+		return sfb < bound[i % 3] ? 7 : scf[(sfb < 12 ? sfb : 11) * 3 + i % 3];
+	}
+	while (cur_sfb_table.index_long[sfb + 1] <= i)
+		++sfb;
+	return sfb < bound[3] ? 7 : scf[sfb < 21 ? sfb : 20];
+}
 
-	//// 0ֵ
-	for (; off < SBLIMIT * SSLIMIT; ++off) {
-		xr[off] = overlapp[ch][off];
-		overlapp[ch][off] = 0.0f;
+static void l3_do_stereo_ref(const struct gr_info* const cur_gr, const struct mpeg_frame* const frame, const unsigned scf[39], const unsigned bound[4], double xr[2][SBLIMIT * SSLIMIT])
+{
+	const int is = frame->is_Intensity && cur_gr->ch[0].block_type == cur_gr->ch[1].block_type && cur_gr->ch[0].mixed_block_flag == cur_gr->ch[1].mixed_block_flag;
+
+	for (unsigned i = 0; i < SBLIMIT * SSLIMIT; ++i) {
+		const double m = xr[0][i], s = xr[1][i];
+		const unsigned is_pos = is ? l3_is_pos_ref(&cur_gr->ch[1], scf, bound, i) : 7;
+
+		if (is_pos < 7) {
+			xr[0][i] = m * is_lr_ref[is_pos][0] * (frame->is_MS ? M_SQRT2 : 1.0);
+			xr[1][i] = m * is_lr_ref[is_pos][1] * (frame->is_MS ? M_SQRT2 : 1.0);
+		} else if (frame->is_MS) {
+			xr[0][i] = m + s;
+			xr[1][i] = m - s;
+		}
+	}
+}
+
+static void l3_antialias_ref(const struct ch_info* cur_ch, double xr[SBLIMIT * SSLIMIT])
+{
+	int sblimit = (SBLIMIT - 1) * SSLIMIT, sb, i;
+
+	if (cur_ch->win_switch_flag && cur_ch->block_type == 2) {
+		if (!cur_ch->mixed_block_flag)
+			return;
+		sblimit = SSLIMIT;
+	}
+
+	for (sb = 0; sb < sblimit; sb += SSLIMIT) {
+		for (i = 0; i < 8; ++i) {
+			const double lo = xr[sb + 17 - i], hi = xr[sb + 18 + i];
+			xr[sb + 17 - i] = lo * cs_ref[i] - hi * ca_ref[i];
+			xr[sb + 18 + i] = hi * cs_ref[i] + lo * ca_ref[i];
+		}
+	}
+}
+
+static void imdct_ref(const double xr[SSLIMIT], double rawout[36], const unsigned char block_type)
+{
+	int i, j, k;
+
+	memset(rawout, 0, 36 * sizeof(double));
+	if (block_type == 2) {
+		for (i = 0; i < 3; ++i) {
+			for (j = 0; j < 12; ++j) {
+				double sum = 0;
+				for (k = 0; k < 6; ++k)
+					sum += xr[i + 3 * k] * imdct_s_ref[k][j];
+				rawout[6 * i + j + 6] += sum * imdct_window_ref[2][j];
+			}
+		}
+	} else {
+		for (j = 0; j < 36; ++j) {
+			double sum = 0;
+			for (k = 0; k < SSLIMIT; ++k)
+				sum += xr[k] * imdct_l_ref[k][j];
+			rawout[j] = sum * imdct_window_ref[block_type][j];
+		}
+	}
+}
+
+static void l3_hybrid_ref(const struct ch_info* cur_ch, const int ch, double xr[SBLIMIT * SSLIMIT])
+{
+	double rawout[36];
+	unsigned off, i;
+
+	for (off = 0; off < SBLIMIT * SSLIMIT; off += SSLIMIT) {
+		const unsigned char block_type = (cur_ch->win_switch_flag && cur_ch->mixed_block_flag && off < 2 * SSLIMIT) ? 0 : cur_ch->block_type;
+
+		imdct_ref(xr + off, rawout, block_type);
+		for (i = 0; i < SSLIMIT; ++i) {
+			xr[off + i] = rawout[i] + overlapp_ref[ch][off + i];
+			overlapp_ref[ch][off + i] = rawout[i + SSLIMIT];
+		}
+	}
+}
+
+// the back end of a granule, sel as in l3_decode_samples
+static void l3_synthesis_ref(struct decoder_handle* const handle, const struct gr_info* const cur_gr, const int sel)
+{
+	const int nch = sel >= 0 ? 1 : handle->cur_frame.nch;
+	double s[32];
+	int ch, sb, ss, i;
+
+	for (ch = 0; ch < nch; ++ch) {
+		const int src = sel < 0 ? ch : sel;
+
+		l3_antialias_ref(&cur_gr->ch[src], xr_ref[src]);
+		l3_hybrid_ref(&cur_gr->ch[src], src, xr_ref[src]);
+
+		for (sb = SSLIMIT; sb < SBLIMIT * SSLIMIT; sb += 2 * SSLIMIT) {
+			for (i = 1; i < SSLIMIT; i += 2)
+				xr_ref[src][sb + i] = -xr_ref[src][sb + i];
+		}
+
+		for (ss = 0; ss < SSLIMIT; ++ss) {
+			for (i = 0; i < 32; ++i)
+				s[i] = xr_ref[src][i * SSLIMIT + ss];
+			synthesis_subband_filter_ref(s, ch, nch, &handle->pcm);
+		}
 	}
 }
 
@@ -808,11 +1209,13 @@ void l3_init(const struct mpeg_header* header)
 	int i, j, k, m;
 	for (i = 0; i < 378; ++i) {
 		k = 46 - i;
-		gain_pow2[i] = (float)pow(2.0, k / 4.0);
+		gain_pow2_ref[i] = pow(2.0, k / 4.0);
+		gain_pow2[i] = (float)gain_pow2_ref[i];
 	}
 
 	for (i = 0; i < 8207; ++i) {
-		gain_powis[i] = (float)pow((double)i, 4.0 / 3.0);
+		gain_powis_ref[i] = pow((double)i, 4.0 / 3.0);
+		gain_powis[i] = (float)gain_powis_ref[i];
 	}
 
 	//for (i = -256; i < 118 + 4; ++i)
@@ -820,54 +1223,63 @@ void l3_init(const struct mpeg_header* header)
 
 	for (i = 0; i < 8; ++i) {
 		double sq = sqrt(1.0 + __Ci[i] * __Ci[i]);
-		cs[i] = (float)(1.0 / sq);
-		ca[i] = (float)(__Ci[i] / sq);
+		cs_ref[i] = 1.0 / sq;
+		ca_ref[i] = __Ci[i] / sq;
+		cs[i] = (float)cs_ref[i];
+		ca[i] = (float)ca_ref[i];
 	}
 
 	{
 		for (i = 0; i < 6; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
-			imdct_window[1][i] = imdct_window[0][i];
-			imdct_window[2][i] = (float)sin(M_PI * k / 24);
-			// imdct_window[3][i] = 0.0f;
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
+			imdct_window_ref[1][i] = imdct_window_ref[0][i];
+			imdct_window_ref[2][i] = sin(M_PI * k / 24);
+			// imdct_window_ref[3][i] = 0.0;
 		}
 
 		for (; i < 12; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
-			imdct_window[1][i] = imdct_window[0][i];
-			imdct_window[2][i] = (float)sin(M_PI * k / 24);
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
+			imdct_window_ref[1][i] = imdct_window_ref[0][i];
+			imdct_window_ref[2][i] = sin(M_PI * k / 24);
 			k -= 16;
-			imdct_window[3][i] = (float)sin(M_PI * k / 24);
+			imdct_window_ref[3][i] = sin(M_PI * k / 24);
 		}
 
 		for (; i < 18; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
-			imdct_window[1][i] = imdct_window[0][i];
-			imdct_window[3][i] = 1.0f;
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
+			imdct_window_ref[1][i] = imdct_window_ref[0][i];
+			imdct_window_ref[3][i] = 1.0;
 		}
 
 		for (; i < 24; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
-			imdct_window[1][i] = 1.0f;
-			imdct_window[3][i] = imdct_window[0][i];
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
+			imdct_window_ref[1][i] = 1.0;
+			imdct_window_ref[3][i] = imdct_window_ref[0][i];
 		}
 
 		for (; i < 30; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
 			k -= 36;
-			imdct_window[1][i] = (float)sin(M_PI * k / 24);
-			imdct_window[3][i] = imdct_window[0][i];
+			imdct_window_ref[1][i] = sin(M_PI * k / 24);
+			imdct_window_ref[3][i] = imdct_window_ref[0][i];
 		}
 
 		for (; i < 36; ++i) {
 			k = 2 * i + 1;
-			imdct_window[0][i] = (float)sin(M_PI * k / 72);
-			imdct_window[3][i] = imdct_window[0][i];
+			imdct_window_ref[0][i] = sin(M_PI * k / 72);
+			imdct_window_ref[3][i] = imdct_window_ref[0][i];
+		}
+
+		for (i = 0; i < 4; ++i) {
+			for (j = 0; j < 36; ++j) {
+				imdct_window[i][j] = (float)imdct_window_ref[i][j];
+				imdct_window_inv[i][j] = j & 1 ? -imdct_window[i][j] : imdct_window[i][j];
+			}
 		}
 	}
 
@@ -875,7 +1287,8 @@ void l3_init(const struct mpeg_header* header)
 	for (i = 0; i < 6; ++i) {
 		m = 7;
 		for (j = 0; j < 12; ++j) {
-			imdct_s[i][j] = (float)cos(M_PI * k * m / 24);
+			imdct_s_ref[i][j] = cos(M_PI * k * m / 24);
+			imdct_s[i][j] = (float)imdct_s_ref[i][j];
 			m += 2;
 		}
 		k += 2;
@@ -885,28 +1298,35 @@ void l3_init(const struct mpeg_header* header)
 	for (i = 0; i < 18; ++i) {
 		m = 19;
 		for (j = 0; j < 36; ++j) {
-			imdct_l[i][j] = (float)cos(M_PI * m * k / 72);
+			imdct_l_ref[i][j] = cos(M_PI * m * k / 72);
+			imdct_l[i][j] = (float)imdct_l_ref[i][j];
 			m += 2;
 		}
 		k += 2;
 	}
 
 	// static float is_coef[] = { 0.0, 0.211324865, 0.366025404, 0.5, 0.633974596, 0.788675135, 1.0 };
-	//float is_ratio;
-	//for (i = 0; i < 7; ++i) {
-	//	is_ratio = tan(i * PI / 12.0);
-	//	is_table[i] = (float)(is_ratio / (1.0 + is_ratio));
-	//}
-	for (i = 0; i < 6; ++i) {
-		is_ratio[i] = (float)tan(i * M_PI / 12);
+	for (i = 0; i < 7; ++i) {
+		const double is_ratio = tan(i * M_PI / 12);
+		// tan(PI / 2) is the whole signal on the left
+		is_lr_ref[i][0] = i == 6 ? 1.0 : is_ratio / (1.0 + is_ratio);
+		is_lr_ref[i][1] = i == 6 ? 0.0 : 1.0 / (1.0 + is_ratio);
+		for (j = 0; j < 2; ++j) {
+			is_lr[0][i][j] = (float)is_lr_ref[i][j];
+			is_lr[1][i][j] = (float)(is_lr_ref[i][j] * M_SQRT2);
+		}
 	}
 
+	// a new stream starts from silence
+	memset(overlapp, 0, sizeof(overlapp));
+	memset(overlapp_ref, 0, sizeof(overlapp_ref));
+
 	init_synthesis_tabs();
 }
 
 static short is[SBLIMIT * SSLIMIT];
 static float xr[2][SBLIMIT * SSLIMIT];
-int l3_decode_samples(struct decoder_handle* handle, uint32_t frame_count)
+int l3_decode_samples(struct decoder_handle* handle)
 {
 	const struct mpeg_frame* const cur_frame = &handle->cur_frame;
 	struct bs* const file_stream = handle->file_stream;
@@ -917,15 +1337,16 @@ int l3_decode_samples(struct decoder_handle* handle, uint32_t frame_count)
 	* short: 36, mixed: 8 + 27, long: 21
 	*/
 	unsigned scalefac[2][39];	// scalefac[ch][sfb], scalefactor band(Ӵ)
+	unsigned is_bound[4];	// see l3_is_bounds
 	int gr, ch;
-	char log_msg_buf[64];
-
 
 	sideinfo_stream->byte_ptr = file_stream->byte_ptr;
 	sideinfo_stream->bit_pos = 0;
-	if (l3_decode_sideinfo(sideinfo_stream, &sideinfo, cur_frame->nch) == -1) {
-		sprintf(log_msg_buf, "frame#%u skipped(decode sideinfo failed)!", frame_count);
-		LOG_E("l3_decode_sideinfo", log_msg_buf);
+	PROFILE_BEGIN(t_si);
+	const int si_ret = l3_decode_sideinfo(sideinfo_stream, &sideinfo, cur_frame->nch, &handle->diag);
+	PROFILE_END(&handle->profile, PROFILE_SIDEINFO, t_si);
+	if (si_ret == -1) {
+		diag_Raise(&handle->diag, DIAG_SIDEINFO);
 		return 1;
 	}
 
@@ -934,12 +1355,9 @@ int l3_decode_samples(struct decoder_handle* handle, uint32_t frame_count)
 	printf("%u <-> %u <-> %u\n", cur_frame->maindata_size, sideinfo.main_data_begin, discard);
 #endif
 	if (bs_Length(maindata_stream) < sideinfo.main_data_begin) {
-		sprintf(log_msg_buf, "frame#%u maindata miss!", frame_count);
-		LOG_E("adjust_maindata", log_msg_buf);
-		if (bs_Append(maindata_stream, sideinfo_stream->byte_ptr, 0, cur_frame->maindata_size) != cur_frame->maindata_size) {
-			sprintf(log_msg_buf, "frame#%u maindata_stream overflow!", frame_count);
-			LOG_E("bs_Append(maindata_stream)", log_msg_buf);
-		}
+		diag_Raise(&handle->diag, DIAG_MAINDATA_MISS);
+		if (bs_Append(maindata_stream, sideinfo_stream->byte_ptr, 0, cur_frame->maindata_size) != cur_frame->maindata_size)
+			diag_Raise(&handle->diag, DIAG_MAINDATA_OVERFLOW);
 		return -1;
 	}
 
@@ -952,60 +1370,121 @@ int l3_decode_samples(struct decoder_handle* handle, uint32_t frame_count)
 #endif
 
 	if (bs_Append(maindata_stream, sideinfo_stream->byte_ptr, 0, cur_frame->maindata_size) != cur_frame->maindata_size) {
-		sprintf(log_msg_buf, "frame#%u maindata_stream overflow!", frame_count);
-		LOG_E("bs_Append(maindata_stream)", log_msg_buf);
+		diag_Raise(&handle->diag, DIAG_MAINDATA_OVERFLOW);
 		return 1;
 	}
 
+	// a selected channel needs the other one only for the joint stereo processing
+	const int sel = handle->channel_mode >= CHANNEL_LEFT && cur_frame->nch == 2 ? (int)handle->channel_mode - CHANNEL_LEFT : -1;
+	const int skip = sel >= 0 && !cur_frame->is_MS && !cur_frame->is_Intensity ? 1 - sel : -1;
+	const int ref = handle->decode_flags & DECODE_REFERENCE;
+	// M/S alone is reconstructed while the side channel is requantized
+	const int fused_ms = cur_frame->nch == 2 && cur_frame->is_MS && !cur_frame->is_Intensity;
+
+	hybrid_len = SBLIMIT * SSLIMIT >> handle->rate_shift;
+
 	for (gr = 0; gr < 2; ++gr) {
 		struct gr_info* cur_gr = &sideinfo.gr[gr];
-		l3_decode_scalefactors(maindata_stream, &cur_gr->ch[0], &sideinfo, gr, 0, scalefac);
-		l3_huffman_decode(maindata_stream, &cur_gr->ch[0], is);
-		l3_requantize(&cur_gr->ch[0], cur_frame, is, scalefac[0], xr[0]);
-
-		if (cur_frame->nch == 2) {
-			l3_decode_scalefactors(maindata_stream, &cur_gr->ch[1], &sideinfo, gr, 1, scalefac);
-			l3_huffman_decode(maindata_stream, &cur_gr->ch[1], is);
-			l3_requantize(&cur_gr->ch[1], cur_frame, is, scalefac[1], xr[1]);
-
-			if (cur_frame->is_MS || cur_frame->is_Intensity) {
-				if (cur_gr->ch[0].nonzero_len > cur_gr->ch[1].nonzero_len)
-					cur_gr->ch[1].nonzero_len = cur_gr->ch[0].nonzero_len;
-				else cur_gr->ch[0].nonzero_len = cur_gr->ch[1].nonzero_len;
-
-				if (cur_frame->is_MS)
-					l3_do_ms_stereo(cur_gr->ch[0].nonzero_len, xr);
-				if (cur_frame->is_Intensity) {
-					LOG_W("chech_stereo", "intesity_stereo not supported!");
-					// l3_do_intesity_stereo(cur_gr, scalefac[0], xr);
-				}
+
+		for (ch = 0; ch < cur_frame->nch; ++ch) {
+			if (ch == skip) {
+				// the scalefactors and Huffman data of a channel are exactly part2_3_length bits
+				bs_skipBits(maindata_stream, cur_gr->ch[ch].part2_3_len);
+				continue;
 			}
+			PROFILE_BEGIN(t_scf);
+			l3_decode_scalefactors(maindata_stream, &cur_gr->ch[ch], &sideinfo, gr, ch, scalefac);
+			PROFILE_END(&handle->profile, PROFILE_SIDEINFO, t_scf);
+			PROFILE_BEGIN(t_huff);
+			l3_huffman_decode(maindata_stream, &cur_gr->ch[ch], is, &handle->diag);
+			// is[] only holds the right channel until it is requantized
+			if (ch == 1 && cur_frame->is_Intensity)
+				l3_is_bounds(&cur_gr->ch[1], is, is_bound);
+			PROFILE_END(&handle->profile, PROFILE_HUFFMAN, t_huff);
+			PROFILE_BEGIN(t_req);
+			if (ref)
+				l3_requantize_ref(&cur_gr->ch[ch], cur_frame, is, scalefac[ch], xr_ref[ch]);
+			else if (ch == 1 && fused_ms)
+				l3_requantize_ms(&cur_gr->ch[1], is, scalefac[1], xr);
+			else l3_requantize(&cur_gr->ch[ch], cur_frame, is, scalefac[ch], xr[ch]);
+			PROFILE_END(&handle->profile, PROFILE_REQUANTIZE, t_req);
 		}
 
-		{
-			int sb, ss, i;
-			float s[32];
-			for (ch = 0; ch < cur_frame->nch; ++ch) {
-				l3_antialias(&sideinfo.gr[gr].ch[ch], xr[ch]);
-				l3_hybrid(&sideinfo.gr[gr].ch[ch], ch, xr[ch]);
-
-				/* frequency inversion */
-				for (sb = 1 * 18; sb < 32 * 18; sb += 2 * 18) {
-					for (i = 1; i < 18; i += 2) {
-						xr[ch][sb + i] = -xr[ch][sb + i];
+		if (cur_frame->nch == 2 && (cur_frame->is_MS || cur_frame->is_Intensity)) {
+			PROFILE_BEGIN(t_st);
+			if (cur_gr->ch[0].nonzero_len > cur_gr->ch[1].nonzero_len)
+				cur_gr->ch[1].nonzero_len = cur_gr->ch[0].nonzero_len;
+			else cur_gr->ch[0].nonzero_len = cur_gr->ch[1].nonzero_len;
+
+			if (ref)
+				l3_do_stereo_ref(cur_gr, cur_frame, scalefac[1], is_bound, xr_ref);
+			else if (!fused_ms)
+				l3_do_stereo(cur_gr, cur_frame, scalefac[1], is_bound, xr, &handle->diag);
+			PROFILE_END(&handle->profile, PROFILE_STEREO, t_st);
+		}
+
+		if (ref) {
+			PROFILE_BEGIN(t_ref);
+			l3_synthesis_ref(handle, cur_gr, sel);
+			PROFILE_END(&handle->profile, PROFILE_SYNTHESIS, t_ref);
+		} else {
+			int ss;
+			// downmix and channel select leave a single channel for the synthesis
+			const int nch = handle->channel_mode == CHANNEL_DOWNMIX || sel >= 0 ? 1 : cur_frame->nch;
+
+			if (nch < cur_frame->nch && sel < 0)
+				l3_downmix(cur_gr, xr, &handle->profile);
+
+			// full rate stereo: both channels through one synthesis pass
+			if (nch == 2 && !handle->rate_shift) {
+				PROFILE_BEGIN(t_hyb);
+				l3_hybrid(&cur_gr->ch[0], 0, xr[0], hybrid_out[0]);
+				l3_hybrid(&cur_gr->ch[1], 1, xr[1], hybrid_out[1]);
+				PROFILE_END(&handle->profile, PROFILE_HYBRID, t_hyb);
+
+				PROFILE_BEGIN(t_syn);
+				for (ss = 0; ss < SSLIMIT; ++ss)
+					synthesis_subband_filter_stereo(hybrid_out[0][ss], hybrid_out[1][ss], &handle->pcm);
+				PROFILE_END(&handle->profile, PROFILE_SYNTHESIS, t_syn);
+			} else {
+				for (ch = 0; ch < nch; ++ch) {
+					const int src = sel < 0 ? ch : sel;
+
+					if (nch == cur_frame->nch || sel >= 0) {
+						PROFILE_BEGIN(t_hyb);
+						l3_hybrid(&cur_gr->ch[src], src, xr[src], hybrid_out[src]);
+						PROFILE_END(&handle->profile, PROFILE_HYBRID, t_hyb);
 					}
-				}
 
-				for (ss = 0; ss < SSLIMIT; ++ss) {
-					for (i = 0; i < 32; i++) {
-						s[i] = xr[ch][i * 18 + ss];
+					PROFILE_BEGIN(t_syn);
+					for (ss = 0; ss < SSLIMIT; ++ss) {
+						/* polyphase subband synthesis */
+						if (handle->rate_shift)
+							synthesis_subband_filter_reduced(hybrid_out[src][ss], ch, nch, handle->rate_shift, &handle->pcm);
+						else synthesis_subband_filter(hybrid_out[src][ss], ch, nch, &handle->pcm);
 					}
-					/* polyphase subband synthesis */
-					synthesis_subband_filter(s, ch, cur_frame->nch, handle->pcm.pcm_buf, handle->pcm.write_off + ch);
+					PROFILE_END(&handle->profile, PROFILE_SYNTHESIS, t_syn);
 				}
 			}
 		}
+
+		if (handle->pcm.write_off[0] == handle->pcm.audio_buf_size)
+			decoder_flushPcm(handle);
 	}
 
 	return 0;
 }
+
+/*
+* Drop the frame without decoding it, but keep its main data in the bit reservoir
+* for the frames that follow.
+*/
+int l3_skip_samples(struct decoder_handle* const handle)
+{
+	const struct mpeg_frame* const cur_frame = &handle->cur_frame;
+	const uint8_t* const maindata = handle->file_stream->byte_ptr + cur_frame->sideinfo_size;
+
+	bs_Append(handle->maindata_stream, maindata, 0, cur_frame->maindata_size);
+
+	return 1;
+}
@@ -49,6 +49,7 @@ struct l3_sideinfo {
 };
 
 void l3_init(const struct mpeg_header* const header);
-int l3_decode_samples(struct decoder_handle* const handle, uint32_t frame_count);
+int l3_decode_samples(struct decoder_handle* const handle);
+int l3_skip_samples(struct decoder_handle* const handle);
 
 #endif // !_MMP_LAYER3_H_
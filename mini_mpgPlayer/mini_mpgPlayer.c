@@ -1,32 +1,101 @@
 ﻿#include "decoder.h"
+#include "paced.h"
+#include "bench.h"
+#include "accuracy.h"
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 
+// enough for about 10 minutes of stereo
+#define TRACE_MAX_EVENTS	(1u << 20)
+
+static void print_frame_hist(const struct latency_hist* const hist)
+{
+	printf("\nframe decode: p50 %.1lfus, p99 %.1lfus, p999 %.1lfus, max %.1lfus", hist_Percentile(hist, 50) / 1e3, hist_Percentile(hist, 99) / 1e3,
+		hist_Percentile(hist, 99.9) / 1e3, hist->max / 1e3);
+}
+
+static void print_paced_stats(void)
+{
+	struct paced_stats st;
+
+	paced_getStats(&st);
+	printf("\nperiods: %u, underruns: %u (%.2lfms)", st.periods, st.underruns, st.underrun_ns / 1e6);
+	printf("\nfill: min %u, max %u, avg %.2lf periods", st.fill_min, st.fill_max, st.fill_avg);
+	printf("\nwakeup jitter: max %.1lfus, avg %.1lfus\n", st.jitter_max_ns / 1e3, st.jitter_avg_ns / 1e3);
+}
+
 int main(int argc, char** argv)
 {
+	enum OUTPUT_FLAGS output_flags = OUTPUT_AUDIO;
+	const char* out_name = NULL;
+	const char* trace_name = NULL;
+	static struct latency_hist frame_hist;
+
+	// --bench ...: decode only, timings as JSON (see bench.h)
+	if (argc >= 2 && !strcmp(argv[1], "--bench"))
+		return bench_Main(argc - 2, argv + 2);
+
+	// --accuracy ...: the float path against the double precision reference (see accuracy.h)
+	if (argc >= 2 && !strcmp(argv[1], "--accuracy"))
+		return accuracy_Main(argc - 2, argv + 2);
+
+	// -trace out.json ...: with MMP_PROFILE, write the stage timeline of the run for chrome://tracing
+	if (argc >= 4 && !strcmp(argv[1], "-trace")) {
+		trace_name = argv[2];
+		argv[2] = argv[0];
+		argv += 2;
+		argc -= 2;
+	}
+
+	// -paced [out.wav]: no device, consume the PCM in real time and report the sink statistics
+	if ((argc == 3 || argc == 4) && !strcmp(argv[1], "-paced")) {
+		output_flags = OUTPUT_PACED;
+		if (argc == 4) {
+			output_flags |= OUTPUT_FILE;
+			out_name = argv[2];
+		}
+		argv += argc - 2;
+		argc = 2;
+	}
+
 	if (argc != 2) {
-		fprintf(stderr, "usage: %s [*.mp3]\n", *argv);
+		fprintf(stderr, "usage: %s [-trace out.json] [-paced [out.wav]] [*.mp3]\n       %s --bench [--runs N] [--warmup N] [--pin CPU] [--preload] *.mp3...\n       %s --accuracy *.mp3...\n", *argv, *argv, *argv);
 		return -1;
 	}
 
 	printf("Input: \"%s\"\n\n", argv[1]);
 
-	struct decoder_handle* decoder = decoder_Init(argv[1], OUTPUT_AUDIO, NULL);
+	struct decoder_handle* decoder = decoder_Init(argv[1], output_flags, out_name);
 	if (!decoder) {
 		LOG_E("decoder_Init", "failed!");
 		return -1;
 	}
+	// MMP_PROFILE builds print the stage times on release
+	decoder->decode_flags |= DECODE_PROFILE_SUMMARY;
+	hist_Reset(&frame_hist);
+	decoder->frame_hist = &frame_hist;
+	if (trace_name && profile_traceBegin(&decoder->profile, TRACE_MAX_EVENTS) == -1)
+		LOG_W("profile_traceBegin", "no trace, build with MMP_PROFILE!");
 
 	clock_t s = clock(), e;
 	uint32_t frame_count = decoder_Run(decoder);
+	const struct decoder_diag diag = decoder->diag;
+	if (trace_name && frame_count && decoder->profile.events && profile_traceWrite(&decoder->profile, trace_name) == -1)
+		LOG_E("profile_traceWrite", "write the trace failed!");
 	decoder_Release(&decoder);
 	e = clock();
 	if (frame_count) {
 		printf("\ntime: %.2lfsecs", ((double)e - s) / CLOCKS_PER_SEC);
+		print_frame_hist(&frame_hist);
 		printf("\nframe count: %u\n", frame_count);
+		diag_Print(stdout, &diag);
+		if (output_flags & OUTPUT_PACED)
+			print_paced_stats();
 	}
 
-	(void)getchar();
+	if (output_flags & OUTPUT_AUDIO)
+		(void)getchar();
 
 	return 0;
 }
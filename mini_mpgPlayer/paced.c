@@ -0,0 +1,117 @@
+#include "paced.h"
+#include "ring.h"
+#include "thread.h"
+#include <string.h>
+
+static struct pcm_ring* g_ring;
+static mmp_thread g_thread;
+static struct wav_sink* g_file;
+static uint32_t g_rate;
+static uint32_t g_frame_size;
+static int g_failed;
+static struct paced_stats g_stats;
+static uint64_t g_fill_sum, g_jitter_sum;
+
+static int paced_sink(void* arg)
+{
+	struct paced_stats* const st = &g_stats;
+	const uint8_t* data;
+	uint64_t start, deadline, now, frames = 0;
+	uint32_t len, fill;
+
+	// the stream clock starts with the first period, like a device started on its first write
+	if (!(data = ring_beginRead(g_ring, &len, 1)))
+		return 0;
+	start = clock_Nanos();
+
+	for (;;) {
+		if (g_file && wav_Write(g_file, data, len) == -1)
+			g_failed = 1;
+		frames += len / g_frame_size;
+		ring_endRead(g_ring);
+		++st->periods;
+
+		deadline = start + frames * 1000000000u / g_rate;
+		sleep_Until(deadline);
+		now = clock_Nanos();
+		g_jitter_sum += now - deadline;
+		if (now - deadline > st->jitter_max_ns)
+			st->jitter_max_ns = now - deadline;
+
+		fill = ring_Fill(g_ring);
+		g_fill_sum += fill;
+		if (fill < st->fill_min)
+			st->fill_min = fill;
+		if (fill > st->fill_max)
+			st->fill_max = fill;
+
+		if (!(data = ring_beginRead(g_ring, &len, 0))) {
+			const int eos = ring_Closed(g_ring);
+			if (!(data = ring_beginRead(g_ring, &len, 1)))
+				break;
+			if (!eos) {
+				// the device would have played silence meanwhile, restart the clock from here
+				++st->underruns;
+				now = clock_Nanos();
+				st->underrun_ns += now - deadline;
+				start = now;
+				frames = 0;
+			}
+		}
+	}
+
+	(void)arg;
+	return 0;
+}
+
+int paced_open(uint32_t rate, uint32_t frame_size, uint32_t period_size, uint32_t periods, struct wav_sink* const file)
+{
+	if (!rate || !frame_size || !(g_ring = ring_Init(periods, period_size, periods / 2, periods)))
+		return -1;
+
+	g_file = file;
+	g_rate = rate;
+	g_frame_size = frame_size;
+	g_failed = 0;
+	memset(&g_stats, 0, sizeof(g_stats));
+	g_stats.fill_min = UINT32_MAX;
+	g_fill_sum = g_jitter_sum = 0;
+
+	if (thread_Create(&g_thread, paced_sink, NULL) == -1) {
+		ring_Release(&g_ring);
+		return -1;
+	}
+
+	return 0;
+}
+
+void paced_close(void)
+{
+	if (g_ring) {
+		ring_Close(g_ring);
+		thread_Join(g_thread);
+		ring_Release(&g_ring);
+
+		if (g_stats.periods) {
+			g_stats.fill_avg = (double)g_fill_sum / g_stats.periods;
+			g_stats.jitter_avg_ns = (double)g_jitter_sum / g_stats.periods;
+		} else
+			g_stats.fill_min = 0;
+	}
+}
+
+int paced_play(const void* data, uint32_t len)
+{
+	if (!g_ring || g_failed || len > ring_periodSize(g_ring))
+		return -1;
+
+	memcpy(ring_beginWrite(g_ring), data, len);
+	ring_endWrite(g_ring, len);
+
+	return 0;
+}
+
+void paced_getStats(struct paced_stats* const stats)
+{
+	*stats = g_stats;
+}
@@ -0,0 +1,28 @@
+#ifndef _MMP_PACED_H_
+#define _MMP_PACED_H_ 1
+
+#include "wav.h"
+#include <stdint.h>
+
+/*
+* Hardware-free output: a sink thread consumes one period per deadline of the stream clock
+* (monotonic clock, sample rate exact) and discards the PCM or writes it to a file sink.
+*/
+struct paced_stats {
+	uint32_t periods;		// periods consumed
+	uint32_t underruns;		// deadlines reached with an empty ring
+	uint64_t underrun_ns;	// total time spent waiting for the decoder after an underrun
+	uint32_t fill_min;		// ring fill in periods, sampled at each deadline
+	uint32_t fill_max;
+	double fill_avg;
+	uint64_t jitter_max_ns;	// wakeup lateness past the deadline
+	double jitter_avg_ns;
+};
+
+int paced_open(uint32_t rate, uint32_t frame_size, uint32_t period_size, uint32_t periods, struct wav_sink* const file);
+void paced_close(void);
+int paced_play(const void* data, uint32_t len);
+// valid after paced_close, until the next paced_open
+void paced_getStats(struct paced_stats* const stats);
+
+#endif // !_MMP_PACED_H_
@@ -0,0 +1,102 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* const stage_str[PROFILE_STAGES] = { "sync", "io", "sideinfo", "huffman", "requantize", "stereo", "hybrid", "synthesis", "output", "frame" };
+
+const char* profile_stageName(const enum PROFILE_STAGE stage)
+{
+	return stage < PROFILE_STAGES ? stage_str[stage] : "?";
+}
+
+#ifdef MMP_PROFILE
+
+void profile_End(struct decoder_profile* const prof, const enum PROFILE_STAGE stage, const uint64_t start)
+{
+	const uint64_t end = __rdtsc();
+
+	if (!prof)
+		return;
+
+	prof->stage[stage].ticks += end - start;
+	++prof->stage[stage].calls;
+
+	if (prof->event_count < prof->event_max) {
+		struct profile_event* const e = &prof->events[prof->event_count++];
+		e->start = start;
+		e->ticks = (uint32_t)(end - start);
+		e->frame = prof->frame;
+		e->stage = stage;
+	}
+}
+
+int profile_traceBegin(struct decoder_profile* const prof, const uint32_t max_events)
+{
+	free(prof->events);
+	prof->event_count = prof->event_max = 0;
+	if (!(prof->events = malloc((size_t)max_events * sizeof(struct profile_event))))
+		return -1;
+	prof->event_max = max_events;
+
+	return 0;
+}
+
+/*
+* One complete ("X") event per stage call on a single track, the frames on a second one,
+* ts/dur in microseconds from the earliest event.
+*/
+int profile_traceWrite(const struct decoder_profile* const prof, const char* const json_name)
+{
+	const double us_per_tick = prof->run_ticks ? prof->run_ns / 1e3 / prof->run_ticks : 0;
+	uint64_t origin = UINT64_MAX;
+	FILE* fp;
+	uint32_t i;
+
+	if (!prof->events || !prof->event_count || !(fp = fopen(json_name, "w")))
+		return -1;
+
+	// the events are recorded as they end, an enclosing stage starts before its first entry
+	for (i = 0; i < prof->event_count; ++i) {
+		if (prof->events[i].start < origin)
+			origin = prof->events[i].start;
+	}
+
+	fprintf(fp, "{ \"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(fp, "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": { \"name\": \"stages\" } },\n");
+	fprintf(fp, "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": { \"name\": \"frames\" } }");
+	for (i = 0; i < prof->event_count; ++i) {
+		const struct profile_event* const e = &prof->events[i];
+		fprintf(fp, ",\n{ \"name\": \"%s\", \"cat\": \"decode\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": { \"frame\": %u } }",
+			stage_str[e->stage], e->stage == PROFILE_FRAME ? 2 : 1, (e->start - origin) * us_per_tick, e->ticks * us_per_tick, e->frame);
+	}
+	fprintf(fp, "\n] }\n");
+
+	return fclose(fp) ? -1 : 0;
+}
+
+#else
+
+int profile_traceBegin(struct decoder_profile* const prof, const uint32_t max_events)
+{
+	(void)prof;
+	(void)max_events;
+	return -1;
+}
+
+int profile_traceWrite(const struct decoder_profile* const prof, const char* const json_name)
+{
+	(void)prof;
+	(void)json_name;
+	return -1;
+}
+
+#endif
+
+void profile_Release(struct decoder_profile* const prof)
+{
+	free(prof->events);
+	prof->events = NULL;
+	prof->event_count = prof->event_max = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef _MMP_PROFILE_H_
+#define _MMP_PROFILE_H_ 1
+
+#include <stdint.h>
+
+/*
+* Per stage time stamp counter ticks and call counts, built in with MMP_PROFILE defined, and optionally
+* a timeline of every stage for chrome://tracing.
+* Without it the macros expand to nothing and decoder_getProfile and the trace functions fail.
+*/
+enum PROFILE_STAGE {
+	PROFILE_SYNC,		// frame sync and header, including the reads it triggers
+	PROFILE_IO,			// file (or memory source) reads
+	PROFILE_SIDEINFO,	// side info and scalefactors
+	PROFILE_HUFFMAN,
+	PROFILE_REQUANTIZE,
+	PROFILE_STEREO,		// M/S, intensity stereo and downmix
+	PROFILE_HYBRID,		// antialias, IMDCT, windowing, overlap and frequency inversion
+	PROFILE_SYNTHESIS,	// polyphase synthesis, one call per granule and channel
+	PROFILE_OUTPUT,		// handing the periods to the outputs
+	PROFILE_FRAME,		// a whole frame from the side info on, the sync excluded
+	PROFILE_STAGES
+};
+
+struct profile_counter {
+	uint64_t ticks;
+	uint64_t calls;
+};
+
+struct profile_event {
+	uint64_t start;
+	uint32_t ticks;
+	uint32_t frame;
+	uint32_t stage;
+};
+
+struct decoder_profile {
+	struct profile_counter stage[PROFILE_STAGES];
+	// the whole decoder_Run in ticks and ns, for the tick rate
+	uint64_t run_ticks;
+	uint64_t run_ns;
+
+	uint32_t frame;		// frame_count of the frame being decoded
+	// timeline, recorded once allocated by profile_traceBegin, later events are dropped
+	struct profile_event* events;
+	uint32_t event_count;
+	uint32_t event_max;
+};
+
+const char* profile_stageName(const enum PROFILE_STAGE stage);
+
+#ifdef MMP_PROFILE
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#define PROFILE_BEGIN(_Var) const uint64_t _Var = __rdtsc()
+#define PROFILE_END(_Prof, _Stage, _Var) profile_End((_Prof), (_Stage), (_Var))
+
+// _Prof may be NULL
+void profile_End(struct decoder_profile* const prof, const enum PROFILE_STAGE stage, const uint64_t start);
+#else
+#define PROFILE_BEGIN(_Var)
+#define PROFILE_END(_Prof, _Stage, _Var) do { } while (0)
+#endif
+
+int profile_traceBegin(struct decoder_profile* const prof, const uint32_t max_events);
+// Chrome trace event JSON, the timestamps are converted with the tick rate of the runs
+int profile_traceWrite(const struct decoder_profile* const prof, const char* const json_name);
+void profile_Release(struct decoder_profile* const prof);
+
+#endif // !_MMP_PROFILE_H_
@@ -0,0 +1,184 @@
+#include "ring.h"
+#include "thread.h"
+#include <stdlib.h>
+
+struct pcm_ring {
+	uint8_t* buf;
+	uint32_t* lens;
+	uint32_t periods;	// power of 2
+	uint32_t period_size;
+	uint32_t low_mark;
+	uint32_t high_mark;
+
+	volatile uint32_t head;	// written by the producer only
+	volatile uint32_t tail;	// written by the consumer only
+	volatile uint32_t closed;
+	volatile uint32_t producer_waiting;
+	volatile uint32_t consumer_waiting;
+
+	mmp_mutex lock;
+	mmp_cond can_write;
+	mmp_cond can_read;
+};
+
+struct pcm_ring* ring_Init(uint32_t periods, uint32_t period_size, uint32_t low_mark, uint32_t high_mark)
+{
+	struct pcm_ring* ring;
+	uint32_t n = 1;
+
+	while (n < periods)
+		n <<= 1;
+	if (high_mark > n || !high_mark)
+		high_mark = n;
+	if (low_mark >= high_mark)
+		low_mark = high_mark - 1;
+
+	do {
+		if (!(ring = calloc(1, sizeof(struct pcm_ring))))
+			break;
+		if (!(ring->buf = malloc((size_t)n * period_size)))
+			break;
+		if (!(ring->lens = calloc(n, sizeof(uint32_t))))
+			break;
+
+		ring->periods = n;
+		ring->period_size = period_size;
+		ring->low_mark = low_mark;
+		ring->high_mark = high_mark;
+		mutex_Init(&ring->lock);
+		cond_Init(&ring->can_write);
+		cond_Init(&ring->can_read);
+
+		return ring;
+	} while (0);
+
+	if (ring) {
+		free(ring->buf);
+		free(ring);
+	}
+
+	return NULL;
+}
+
+void ring_Release(struct pcm_ring** const ring)
+{
+	if (ring && *ring) {
+		cond_Destroy(&(*ring)->can_read);
+		cond_Destroy(&(*ring)->can_write);
+		mutex_Destroy(&(*ring)->lock);
+		free((*ring)->lens);
+		free((*ring)->buf);
+		free(*ring);
+		*ring = NULL;
+	}
+}
+
+uint32_t ring_Fill(struct pcm_ring* const ring)
+{
+	return atomic_Load(&ring->head) - atomic_Load(&ring->tail);
+}
+
+int ring_Closed(struct pcm_ring* const ring)
+{
+	return (int)atomic_Load(&ring->closed);
+}
+
+uint32_t ring_Periods(const struct pcm_ring* const ring)
+{
+	return ring->periods;
+}
+
+uint32_t ring_periodSize(const struct pcm_ring* const ring)
+{
+	return ring->period_size;
+}
+
+uint8_t* ring_Slot(struct pcm_ring* const ring, uint32_t index)
+{
+	return ring->buf + (size_t)(index & (ring->periods - 1)) * ring->period_size;
+}
+
+/*
+* Sleep until the other side makes the predicate true.
+* The waiting flag is published before the predicate is re-checked under the lock,
+* and the other side checks the flag after publishing its index, so no wakeup is lost.
+*/
+static void wait_producer(struct pcm_ring* const ring, const uint32_t max_fill)
+{
+	mutex_Lock(&ring->lock);
+	atomic_Store(&ring->producer_waiting, 1);
+	while (ring_Fill(ring) > max_fill)
+		cond_Wait(&ring->can_write, &ring->lock);
+	atomic_Store(&ring->producer_waiting, 0);
+	mutex_Unlock(&ring->lock);
+}
+
+static void wait_consumer(struct pcm_ring* const ring)
+{
+	mutex_Lock(&ring->lock);
+	atomic_Store(&ring->consumer_waiting, 1);
+	while (!ring_Fill(ring) && !atomic_Load(&ring->closed))
+		cond_Wait(&ring->can_read, &ring->lock);
+	atomic_Store(&ring->consumer_waiting, 0);
+	mutex_Unlock(&ring->lock);
+}
+
+static void wake(struct pcm_ring* const ring, mmp_cond* const cond)
+{
+	mutex_Lock(&ring->lock);
+	cond_Signal(cond);
+	mutex_Unlock(&ring->lock);
+}
+
+uint8_t* ring_beginWrite(struct pcm_ring* const ring)
+{
+	if (ring_Fill(ring) >= ring->high_mark)
+		wait_producer(ring, ring->low_mark);
+
+	return ring_Slot(ring, ring->head);
+}
+
+void ring_endWrite(struct pcm_ring* const ring, uint32_t len)
+{
+	ring->lens[ring->head & (ring->periods - 1)] = len;
+	atomic_Store(&ring->head, ring->head + 1);
+
+	if (atomic_Load(&ring->consumer_waiting))
+		wake(ring, &ring->can_read);
+}
+
+void ring_Close(struct pcm_ring* const ring)
+{
+	atomic_Store(&ring->closed, 1);
+
+	if (atomic_Load(&ring->consumer_waiting))
+		wake(ring, &ring->can_read);
+}
+
+void ring_Drain(struct pcm_ring* const ring)
+{
+	if (ring_Fill(ring))
+		wait_producer(ring, 0);
+}
+
+const uint8_t* ring_beginRead(struct pcm_ring* const ring, uint32_t* const len, const int wait)
+{
+	if (!ring_Fill(ring)) {
+		if (!wait)
+			return NULL;
+		wait_consumer(ring);
+		if (!ring_Fill(ring))
+			return NULL;
+	}
+
+	*len = ring->lens[ring->tail & (ring->periods - 1)];
+	return ring_Slot(ring, ring->tail);
+}
+
+void ring_endRead(struct pcm_ring* const ring)
+{
+	atomic_Store(&ring->tail, ring->tail + 1);
+
+	if (atomic_Load(&ring->producer_waiting) && ring_Fill(ring) <= ring->low_mark)
+		wake(ring, &ring->can_write);
+}
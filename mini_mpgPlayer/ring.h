@@ -0,0 +1,32 @@
+#ifndef _MMP_RING_H_
+#define _MMP_RING_H_ 1
+
+#include <stdint.h>
+
+/*
+* Single-producer/single-consumer ring of preallocated PCM periods.
+* The indices are updated lock-free; a side only takes the lock when it has to sleep
+* (producer: ring filled up to high_mark, until it drains to low_mark; consumer: ring empty).
+*/
+struct pcm_ring;
+
+struct pcm_ring* ring_Init(uint32_t periods, uint32_t period_size, uint32_t low_mark, uint32_t high_mark);
+void ring_Release(struct pcm_ring** const ring);
+
+uint32_t ring_Fill(struct pcm_ring* const ring);
+int ring_Closed(struct pcm_ring* const ring);
+uint32_t ring_Periods(const struct pcm_ring* const ring);
+uint32_t ring_periodSize(const struct pcm_ring* const ring);
+uint8_t* ring_Slot(struct pcm_ring* const ring, uint32_t index);
+
+// producer
+uint8_t* ring_beginWrite(struct pcm_ring* const ring);
+void ring_endWrite(struct pcm_ring* const ring, uint32_t len);
+void ring_Close(struct pcm_ring* const ring);
+void ring_Drain(struct pcm_ring* const ring);
+
+// consumer, ring_beginRead returns NULL when empty and !wait, or when closed and drained
+const uint8_t* ring_beginRead(struct pcm_ring* const ring, uint32_t* const len, const int wait);
+void ring_endRead(struct pcm_ring* const ring);
+
+#endif // !_MMP_RING_H_
@@ -1,14 +1,15 @@
 #include "synth.h"
-#include <stdbool.h>
 #include <math.h>
+#include <string.h>
 #include <immintrin.h>
 
 #define M_PI       3.14159265358979323846
 
 /*
-coefficients Di for the synthesis window
+coefficients Di for the synthesis window, in the order the windowing reads them: 32 for the newest half of V
+of every even block, 32 for the older half of every odd one
 */
-static const float _D[512] =
+static MMP_ALIGN(32) const float _D[512] =
 {
 	0.000000000f, -0.000015259f, -0.000015259f, -0.000015259f,
 	-0.000015259f, -0.000015259f, -0.000015259f, -0.000030518f,
@@ -146,28 +147,47 @@ coefficients Nik for the synthesis window
 // static float _N[64][32]; // need init ( _N[i][k] = cos((16+i)*(2*k+1)*PI/64) )
 static float _N[32][32]; // need init ( _N[i][k] = cos(i*(2*k+1)*PI/64) )
 
-static float _U[512];
-static float _V[2][1024];
+/*
+reduced rate synthesis of the lowest M = 16 or 8 subbands, see synthesis_subband_filter_reduced
+_N16[i][k] = cos(i*(2*k+1)*PI/32), _N8[i][k] = cos(i*(2*k+1)*PI/16), _D2/_D4: every 2nd/4th Di
+*/
+static float _N16[16][16], _N8[8][8];
+static MMP_ALIGN(32) float _D2[256], _D4[128];
+
+/*
+V of each channel as a ring of 16 blocks of 64 values (2M for the reduced synthesis), the newest at _V_pos.
+Every block is stored twice, 16 blocks apart, so the 16 blocks from the newest one are contiguous and
+a call writes one block instead of shifting the other 15.
+*/
+static MMP_ALIGN(32) float _V[2][2048];
+static unsigned _V_pos[2];
+
+/*
+reference synthesis (synthesis_subband_filter_ref) in double precision, the Di as tabulated above
+_N_ref[i][k] = cos((16+i)*(2*k+1)*PI/64)
+*/
+static double _N_ref[64][32];
+static double _V_ref[2][1024];
 
-static void memcpy_dword(void* dst, const void* src, uint32_t cnt, bool down)
+// the 32 DCT outputs to the new block of 64 in V
+static void dct_to_v(const float f_out[32], float V[64])
 {
-	if (down)
-		__asm std;
-
-	__asm {
-		mov edi, dword ptr[dst]
-		mov esi, dword ptr[src]
-		mov ecx, dword ptr[cnt]
-		rep movsd
-		cld
-	}
+	int i;
+
+	memcpy(V, f_out + 16, 16 * sizeof(float));
+	V[16] = 0;
+	for (i = 17; i < 48; ++i)
+		V[i] = -f_out[48 - i];
+	for (; i < 64; ++i)
+		V[i] = -f_out[i - 48];
 }
 
-static void dct32to64(const float s[32], const uint8_t ch)
+// V: the new block of 64
+static void dct32to64(const float s[32], float V[64])
 {
 	float f_out[32], f_tmp[4];
-	__m128 f4_S0 = _mm_loadu_ps(s), f4_S1 = _mm_loadu_ps(s + 4), f4_S2 = _mm_loadu_ps(s + 8), f4_S3 = _mm_loadu_ps(s + 12), f4_S4 = _mm_loadu_ps(s + 16);
-	__m128 f4_S5 = _mm_loadu_ps(s + 20), f4_S6 = _mm_loadu_ps(s + 24), f4_S7 = _mm_loadu_ps(s + 28);
+	__m128 f4_S0 = _mm_load_ps(s), f4_S1 = _mm_load_ps(s + 4), f4_S2 = _mm_load_ps(s + 8), f4_S3 = _mm_load_ps(s + 12), f4_S4 = _mm_load_ps(s + 16);
+	__m128 f4_S5 = _mm_load_ps(s + 20), f4_S6 = _mm_load_ps(s + 24), f4_S7 = _mm_load_ps(s + 28);
 	int i;
 
 	for (i = 0; i < 32; ++i) {
@@ -183,12 +203,40 @@ static void dct32to64(const float s[32], const uint8_t ch)
 		f_out[i] = f_tmp[0] + f_tmp[1] + f_tmp[2] + f_tmp[3];
 	}
 
-	memcpy_dword(_V[ch], f_out + 16, 16, 0);
-	_V[ch][16] = 0;
-	for (i = 17; i < 48; ++i)
-		_V[ch][i] = -f_out[48 - i];
-	for (; i < 64; ++i)
-		_V[ch][i] = -f_out[i - 48];
+	dct_to_v(f_out, V);
+}
+
+// dct32to64 of both channels, every _N row is loaded once for the two
+static void dct32to64_stereo(const float s0[32], const float s1[32], float V0[64], float V1[64])
+{
+	float f_out[2][32], f_tmp[4];
+	__m128 f4_S0 = _mm_load_ps(s0), f4_S1 = _mm_load_ps(s0 + 4), f4_S2 = _mm_load_ps(s0 + 8), f4_S3 = _mm_load_ps(s0 + 12), f4_S4 = _mm_load_ps(s0 + 16);
+	__m128 f4_S5 = _mm_load_ps(s0 + 20), f4_S6 = _mm_load_ps(s0 + 24), f4_S7 = _mm_load_ps(s0 + 28);
+	int i;
+
+	for (i = 0; i < 32; ++i) {
+		__m128 f4_N = _mm_loadu_ps(_N[i]);
+		__m128 f4_sum0 = _mm_mul_ps(f4_N, f4_S0), f4_sum1 = _mm_mul_ps(f4_N, _mm_load_ps(s1));
+#define DCT_STEP(_J, _S) \
+		f4_N = _mm_loadu_ps(_N[i] + (_J)); \
+		f4_sum0 = _mm_add_ps(f4_sum0, _mm_mul_ps(f4_N, (_S))); \
+		f4_sum1 = _mm_add_ps(f4_sum1, _mm_mul_ps(f4_N, _mm_load_ps(s1 + (_J))))
+		DCT_STEP(4, f4_S1);
+		DCT_STEP(8, f4_S2);
+		DCT_STEP(12, f4_S3);
+		DCT_STEP(16, f4_S4);
+		DCT_STEP(20, f4_S5);
+		DCT_STEP(24, f4_S6);
+		DCT_STEP(28, f4_S7);
+#undef DCT_STEP
+		_mm_storeu_ps(f_tmp, f4_sum0);
+		f_out[0][i] = f_tmp[0] + f_tmp[1] + f_tmp[2] + f_tmp[3];
+		_mm_storeu_ps(f_tmp, f4_sum1);
+		f_out[1][i] = f_tmp[0] + f_tmp[1] + f_tmp[2] + f_tmp[3];
+	}
+
+	dct_to_v(f_out[0], V0);
+	dct_to_v(f_out[1], V1);
 }
 
 #if 0
@@ -253,161 +301,297 @@ void init_synthesis_tabs(void)
 		}
 	}
 
+	for (i = 0; i < 16; ++i) {
+		for (j = 0; j < 16; ++j)
+			_N16[i][j] = (float)cos(i * (2 * j + 1) * M_PI / 32.0);
+	}
+	for (i = 0; i < 8; ++i) {
+		for (j = 0; j < 8; ++j)
+			_N8[i][j] = (float)cos(i * (2 * j + 1) * M_PI / 16.0);
+	}
+	for (i = 0; i < 256; ++i)
+		_D2[i] = _D[i * 2];
+	for (i = 0; i < 128; ++i)
+		_D4[i] = _D[i * 4];
+
+	for (i = 0; i < 64; ++i) {
+		for (j = 0; j < 32; ++j)
+			_N_ref[i][j] = cos((16 + i) * (2 * j + 1) * M_PI / 64.0);
+	}
+
+	// a new stream starts from silence
+	memset(_V, 0, sizeof(_V));
+	memset(_V_pos, 0, sizeof(_V_pos));
+	memset(_V_ref, 0, sizeof(_V_ref));
+
 	//for (i = 0; i < 512; ++i) {
 	//	_D[i] *= 32767.0;
 	//}
 }
 
-void synthesis_subband_filter(const float s[32], const uint8_t ch, const uint8_t nch, uint8_t* pcm_buf, uint32_t* off)
+/*
+* PCM writers, one per sample format, f4_sum holds n4 * 4 samples of one channel in [-1.0, 1.0).
+* Mono and planar output is contiguous; interleaved stereo stores cover whole frames and keep the lanes
+* of the other channel (i4_mask selects the lanes of this channel, all of them for a mono stream).
+*/
+static void store_masked(uint8_t* out, const __m128i i4_v, const __m128i i4_mask)
+{
+	const __m128i i4_old = _mm_loadu_si128((const __m128i*)out);
+	_mm_storeu_si128((__m128i*)out, _mm_or_si128(_mm_and_si128(i4_v, i4_mask), _mm_andnot_si128(i4_mask, i4_old)));
+}
+
+static void store_x32(uint8_t* out, const __m128i i4_v, const __m128i i4_mask, const int contiguous)
 {
-	static __m128 f4_32768 = { 32768.0f, 32768.0f, 32768.0f, 32768.0f };
+	if (contiguous) {
+		_mm_storeu_si128((__m128i*)out, i4_v);
+	} else {
+		store_masked(out, _mm_unpacklo_epi32(i4_v, i4_v), i4_mask);
+		store_masked(out + 16, _mm_unpackhi_epi32(i4_v, i4_v), i4_mask);
+	}
+}
+
+static void write_s16(const __m128 f4_sum[8], const int n4, uint8_t* out, const __m128i i4_mask, const int contiguous)
+{
+	const __m128 f4_scale = _mm_set1_ps(32768.0f), f4_max = _mm_set1_ps(32767.0f);
 	int i;
+
+	for (i = 0; i < n4; i += 2, out += contiguous ? 16 : 32) {
+		// round to nearest, packs saturates the negative side
+		const __m128i i4_lo = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum[i], f4_scale), f4_max));
+		const __m128i i4_hi = _mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum[i + 1], f4_scale), f4_max));
+		const __m128i i8_s = _mm_packs_epi32(i4_lo, i4_hi);
+
+		if (contiguous) {
+			_mm_storeu_si128((__m128i*)out, i8_s);
+		} else {
+			store_masked(out, _mm_unpacklo_epi16(i8_s, i8_s), i4_mask);
+			store_masked(out + 16, _mm_unpackhi_epi16(i8_s, i8_s), i4_mask);
+		}
+	}
+}
+
+// s24 (24 bits in the high bytes, the low byte 0) and s32
+static void write_s32(const __m128 f4_sum[8], const int n4, uint8_t* out, const __m128i i4_mask, const int contiguous, const int bits)
+{
+	const __m128 f4_scale = _mm_set1_ps(bits == 32 ? 2147483648.0f : 8388608.0f);
+	const __m128 f4_max = _mm_set1_ps(bits == 32 ? 2147483520.0f : 8388607.0f);	// largest float below 2^31
+	const __m128 f4_min = _mm_set1_ps(bits == 32 ? -2147483648.0f : -8388608.0f);
+	const __m128i i4_shift = _mm_cvtsi32_si128(32 - bits);
+	int i;
+
+	for (i = 0; i < n4; ++i, out += contiguous ? 16 : 32) {
+		const __m128i i4_v = _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(f4_sum[i], f4_scale), f4_max), f4_min));
+		store_x32(out, _mm_sll_epi32(i4_v, i4_shift), i4_mask, contiguous);
+	}
+}
+
+// no quantization and no clipping
+static void write_f32(const __m128 f4_sum[8], const int n4, uint8_t* out, const __m128i i4_mask, const int contiguous)
+{
+	int i;
+
+	for (i = 0; i < n4; ++i, out += contiguous ? 16 : 32)
+		store_x32(out, _mm_castps_si128(f4_sum[i]), i4_mask, contiguous);
+}
+
+static void write_samples(const __m128 f4_sum[8], const int n4, const uint8_t ch, const uint8_t nch, struct pcm_stream* const pcm)
+{
+	uint8_t* const out = pcm->pcm_buf + pcm->write_off[ch];
+	const int contiguous = pcm->planar || pcm->channels == 1;
+	__m128i i4_mask = _mm_set1_epi32(-1);
+	int copies = 1, i;
+
+	if (contiguous) {
+		if (nch < pcm->channels)
+			copies = 2;	// second plane
+	} else if (nch == 2) {
+		if (pcm->sample_size == 2)
+			i4_mask = _mm_set1_epi32(ch ? (int)0xffff0000 : 0x0000ffff);
+		else i4_mask = ch ? _mm_set_epi32(-1, 0, -1, 0) : _mm_set_epi32(0, -1, 0, -1);
+	}
+
+	for (i = 0; i < copies; ++i) {
+		uint8_t* const dst = out + i * pcm->audio_buf_size;
+		switch (pcm->format) {
+		case SAMPLE_S16:
+			write_s16(f4_sum, n4, dst, i4_mask, contiguous);
+			break;
+		case SAMPLE_S24_32:
+			write_s32(f4_sum, n4, dst, i4_mask, contiguous, 24);
+			break;
+		case SAMPLE_S32:
+			write_s32(f4_sum, n4, dst, i4_mask, contiguous, 32);
+			break;
+		case SAMPLE_F32:
+			write_f32(f4_sum, n4, dst, i4_mask, contiguous);
+			break;
+		}
+	}
+
+	pcm->write_off[ch] += n4 * 4 * pcm->sample_size * (contiguous ? 1 : 2);
+}
+
+void synthesis_subband_filter(const float s[32], const uint8_t ch, const uint8_t nch, struct pcm_stream* const pcm)
+{
+	float* V;
+	int i, j;
 	__m128 f4_sum[8] = { 0 };
-	float f_tmp[8 * 4];
 
-	// Shifting
-	memcpy_dword(_V[ch] + 1023, _V[ch] + 1023 - 64, 960, 1);	// using loop queue?
+	// Shifting, one block back in the ring
+	_V_pos[ch] = (_V_pos[ch] - 1) & 15;
+	V = _V[ch] + _V_pos[ch] * 64;
 
 	// Matrixing (DCT(32 -> 64))
-	dct32to64(s, ch);
+	dct32to64(s, V);
+	memcpy(V + 1024, V, 64 * sizeof(float));
 
 	/*
-	* Build a 512 values vector U
-	* Window by 512 coefficients
+	* Window by 512 coefficients and sum the 16 vectors of the U
+	* Output 32 reconstructed PCM Samples
 	*/
 	for (i = 0; i < 512; i += 64) {
-#if 1
-		__m128 f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2]), _mm_loadu_ps(&_D[i]));
-		_mm_storeu_ps(&_U[i], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96]), _mm_loadu_ps(&_D[i + 32]));
-		_mm_storeu_ps(&_U[i + 32], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 4]), _mm_loadu_ps(&_D[i + 4]));
-		_mm_storeu_ps(&_U[i + 4], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 4]), _mm_loadu_ps(&_D[i + 32 + 4]));
-		_mm_storeu_ps(&_U[i + 32 + 4], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 8]), _mm_loadu_ps(&_D[i + 8]));
-		_mm_storeu_ps(&_U[i + 8], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 8]), _mm_loadu_ps(&_D[i + 32 + 8]));
-		_mm_storeu_ps(&_U[i + 32 + 8], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 12]), _mm_loadu_ps(&_D[i + 12]));
-		_mm_storeu_ps(&_U[i + 12], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 12]), _mm_loadu_ps(&_D[i + 32 + 12]));
-		_mm_storeu_ps(&_U[i + 32 + 12], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 16]), _mm_loadu_ps(&_D[i + 16]));
-		_mm_storeu_ps(&_U[i + 16], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 16]), _mm_loadu_ps(&_D[i + 32 + 16]));
-		_mm_storeu_ps(&_U[i + 32 + 16], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 20]), _mm_loadu_ps(&_D[i + 20]));
-		_mm_storeu_ps(&_U[i + 20], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 20]), _mm_loadu_ps(&_D[i + 32 + 20]));
-		_mm_storeu_ps(&_U[i + 32 + 20], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 24]), _mm_loadu_ps(&_D[i + 24]));
-		_mm_storeu_ps(&_U[i + 24], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 24]), _mm_loadu_ps(&_D[i + 32 + 24]));
-		_mm_storeu_ps(&_U[i + 32 + 24], f4_U);
-
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 28]), _mm_loadu_ps(&_D[i + 28]));
-		_mm_storeu_ps(&_U[i + 28], f4_U);
-		f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + 28]), _mm_loadu_ps(&_D[i + 32 + 28]));
-		_mm_storeu_ps(&_U[i + 32 + 28], f4_U);
-#else
-		for (j = 0; j < 32; j += 4) {
-			__m128 f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + j]), _mm_loadu_ps(&_D[i + j]));
-			_mm_storeu_ps(&_U[i + j], f4_U);
-			f4_U = _mm_mul_ps(_mm_loadu_ps(&_V[ch][i * 2 + 96 + j]), _mm_loadu_ps(&_D[i + 32 + j]));
-			_mm_storeu_ps(&_U[i + 32 + j], f4_U);
+		const float* const v = V + i * 2, * const d = _D + i;
+
+		for (j = 0; j < 8; ++j)
+			f4_sum[j] = _mm_add_ps(f4_sum[j], _mm_mul_ps(_mm_load_ps(v + j * 4), _mm_load_ps(d + j * 4)));
+		for (j = 0; j < 8; ++j)
+			f4_sum[j] = _mm_add_ps(f4_sum[j], _mm_mul_ps(_mm_load_ps(v + 96 + j * 4), _mm_load_ps(d + 32 + j * 4)));
+	}
+
+	write_samples(f4_sum, 8, ch, nch, pcm);
+}
+
+/*
+* synthesis_subband_filter of both channels of a stereo stream in one pass, the _N and _D loads are shared.
+* Interleaved s16 output is stored as whole L/R frames, without the masked stores of the other formats.
+*/
+void synthesis_subband_filter_stereo(const float s0[32], const float s1[32], struct pcm_stream* const pcm)
+{
+	float* V0, * V1;
+	int i, j;
+	__m128 f4_sum0[8] = { 0 }, f4_sum1[8] = { 0 };
+
+	// Shifting, one block back in both rings
+	_V_pos[0] = (_V_pos[0] - 1) & 15;
+	_V_pos[1] = (_V_pos[1] - 1) & 15;
+	V0 = _V[0] + _V_pos[0] * 64;
+	V1 = _V[1] + _V_pos[1] * 64;
+
+	// Matrixing (DCT(32 -> 64))
+	dct32to64_stereo(s0, s1, V0, V1);
+	memcpy(V0 + 1024, V0, 64 * sizeof(float));
+	memcpy(V1 + 1024, V1, 64 * sizeof(float));
+
+	// Windowing and summing, as in synthesis_subband_filter
+	for (i = 0; i < 512; i += 64) {
+		const float* const v0 = V0 + i * 2, * const v1 = V1 + i * 2, * const d = _D + i;
+
+		for (j = 0; j < 8; ++j) {
+			const __m128 f4_D = _mm_load_ps(d + j * 4);
+			f4_sum0[j] = _mm_add_ps(f4_sum0[j], _mm_mul_ps(_mm_load_ps(v0 + j * 4), f4_D));
+			f4_sum1[j] = _mm_add_ps(f4_sum1[j], _mm_mul_ps(_mm_load_ps(v1 + j * 4), f4_D));
+		}
+		for (j = 0; j < 8; ++j) {
+			const __m128 f4_D = _mm_load_ps(d + 32 + j * 4);
+			f4_sum0[j] = _mm_add_ps(f4_sum0[j], _mm_mul_ps(_mm_load_ps(v0 + 96 + j * 4), f4_D));
+			f4_sum1[j] = _mm_add_ps(f4_sum1[j], _mm_mul_ps(_mm_load_ps(v1 + 96 + j * 4), f4_D));
 		}
-#endif
 	}
 
-	/*
-	* Calculate 32 Samples
-	* Output 32 reconstructed PCM Samples
-	*/
-	for (i = 0; i < 512; i += 32) {
-		f4_sum[0] = _mm_add_ps(f4_sum[0], _mm_loadu_ps(_U + i));
-		f4_sum[1] = _mm_add_ps(f4_sum[1], _mm_loadu_ps(_U + i + 4));
-		f4_sum[2] = _mm_add_ps(f4_sum[2], _mm_loadu_ps(_U + i + 8));
-		f4_sum[3] = _mm_add_ps(f4_sum[3], _mm_loadu_ps(_U + i + 12));
-		f4_sum[4] = _mm_add_ps(f4_sum[4], _mm_loadu_ps(_U + i + 16));
-		f4_sum[5] = _mm_add_ps(f4_sum[5], _mm_loadu_ps(_U + i + 20));
-		f4_sum[6] = _mm_add_ps(f4_sum[6], _mm_loadu_ps(_U + i + 24));
-		f4_sum[7] = _mm_add_ps(f4_sum[7], _mm_loadu_ps(_U + i + 28));
+	if (pcm->format == SAMPLE_S16 && !pcm->planar && pcm->channels == 2 && pcm->write_off[0] == pcm->write_off[1]) {
+		const __m128 f4_scale = _mm_set1_ps(32768.0f), f4_max = _mm_set1_ps(32767.0f);
+		uint8_t* out = pcm->pcm_buf + pcm->write_off[0];
+
+		for (i = 0; i < 8; i += 2, out += 32) {
+			// as write_s16, then L/R pairs
+			const __m128i i8_l = _mm_packs_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum0[i], f4_scale), f4_max)),
+				_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum0[i + 1], f4_scale), f4_max)));
+			const __m128i i8_r = _mm_packs_epi32(_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum1[i], f4_scale), f4_max)),
+				_mm_cvtps_epi32(_mm_min_ps(_mm_mul_ps(f4_sum1[i + 1], f4_scale), f4_max)));
+
+			_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi16(i8_l, i8_r));
+			_mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi16(i8_l, i8_r));
+		}
+		pcm->write_off[0] += 32 * 4;
+		pcm->write_off[1] += 32 * 4;
+	} else {
+		write_samples(f4_sum0, 8, 0, 2, pcm);
+		write_samples(f4_sum1, 8, 1, 2, pcm);
 	}
+}
 
-	f4_sum[0] = _mm_mul_ps(f4_sum[0], f4_32768);
-	_mm_storeu_ps(f_tmp, f4_sum[0]);
-	f4_sum[1] = _mm_mul_ps(f4_sum[1], f4_32768);
-	_mm_storeu_ps(f_tmp + 4, f4_sum[1]);
-	f4_sum[2] = _mm_mul_ps(f4_sum[2], f4_32768);
-	_mm_storeu_ps(f_tmp + 8, f4_sum[2]);
-	f4_sum[3] = _mm_mul_ps(f4_sum[3], f4_32768);
-	_mm_storeu_ps(f_tmp + 12, f4_sum[3]);
-	f4_sum[4] = _mm_mul_ps(f4_sum[4], f4_32768);
-	_mm_storeu_ps(f_tmp + 16, f4_sum[4]);
-	f4_sum[5] = _mm_mul_ps(f4_sum[5], f4_32768);
-	_mm_storeu_ps(f_tmp + 20, f4_sum[5]);
-	f4_sum[6] = _mm_mul_ps(f4_sum[6], f4_32768);
-	_mm_storeu_ps(f_tmp + 24, f4_sum[6]);
-	f4_sum[7] = _mm_mul_ps(f4_sum[7], f4_32768);
-	_mm_storeu_ps(f_tmp + 28, f4_sum[7]);
-
-#if 1
-	// Output reconstructed PCM Sample
-	for (i = 0; i < 32; i += 4) {
-		int16_t* pcm_out = (int16_t*)(pcm_buf + *off);
-		if (f_tmp[i] >= 32766.5f) {
-			pcm_out[0] = 32767;
-		} else if (f_tmp[i] <= -32767.5f) {
-			pcm_out[0] = -32768;
-		} else if ((pcm_out[0] = (int16_t)(f_tmp[i] + 0.5f)) < 0)
-			pcm_out[0] -= 1;
-		///////////
-		if (f_tmp[i + 1] >= 32766.5f) {
-			pcm_out[2] = 32767;
-		} else if (f_tmp[i + 1] <= -32767.5f) {
-			pcm_out[2] = -32768;
-		} else if ((pcm_out[2] = (int16_t)(f_tmp[i + 1] + 0.5f)) < 0)
-			pcm_out[2] -= 1;
+/*
+* Polyphase synthesis of the lowest M = 32 >> shift subbands at 1 / (1 << shift) of the stream rate:
+* an M point DCT into a 32 * M values V and the window decimated by 1 << shift, which gives every
+* (1 << shift)th sample of the full rate output of those subbands.
+*/
+void synthesis_subband_filter_reduced(const float s[32], const uint8_t ch, const uint8_t nch, const uint8_t shift, struct pcm_stream* const pcm)
+{
+	const int M = 32 >> shift;
+	const float* const N = shift == 1 ? _N16[0] : _N8[0];
+	const float* const D = shift == 1 ? _D2 : _D4;
+	float* V;
+	float f_out[16], f_tmp[4];
+	__m128 f4_sum[8] = { 0 };
+	int i, j;
 
-		///////////
-		if (f_tmp[i + 2] >= 32766.5f) {
-			pcm_out[4] = 32767;
-		} else if (f_tmp[i + 2] <= -32767.5f) {
-			pcm_out[4] = -32768;
-		} else if ((pcm_out[4] = (int16_t)(f_tmp[i + 2] + 0.5f)) < 0)
-			pcm_out[4] -= 1;
-		///////////
-		if (f_tmp[i + 3] >= 32766.5f) {
-			pcm_out[6] = 32767;
-		} else if (f_tmp[i + 3] <= -32767.5f) {
-			pcm_out[6] = -32768;
-		} else if ((pcm_out[6] = (int16_t)(f_tmp[i + 3] + 0.5f)) < 0)
-			pcm_out[6] -= 1;
-		////////
+	// Shifting, one block of 2M back in the ring
+	_V_pos[ch] = (_V_pos[ch] - 1) & 15;
+	V = _V[ch] + _V_pos[ch] * 2 * M;
+
+	// Matrixing (DCT(M -> 2M))
+	for (i = 0; i < M; ++i) {
+		__m128 f4_dot = _mm_setzero_ps();
+		for (j = 0; j < M; j += 4)
+			f4_dot = _mm_add_ps(f4_dot, _mm_mul_ps(_mm_loadu_ps(N + i * M + j), _mm_load_ps(s + j)));
+		_mm_storeu_ps(f_tmp, f4_dot);
+		f_out[i] = f_tmp[0] + f_tmp[1] + f_tmp[2] + f_tmp[3];
+	}
+
+	memcpy(V, f_out + M / 2, M / 2 * sizeof(float));
+	V[M / 2] = 0;
+	for (i = M / 2 + 1; i < M * 3 / 2; ++i)
+		V[i] = -f_out[M * 3 / 2 - i];
+	for (; i < 2 * M; ++i)
+		V[i] = -f_out[i - M * 3 / 2];
+	memcpy(V + 32 * M, V, 2 * M * sizeof(float));
 
-		if (nch == 1) {
-			pcm_out[1] = pcm_out[0];
-			pcm_out[3] = pcm_out[2];
-			pcm_out[5] = pcm_out[4];
-			pcm_out[7] = pcm_out[6];
+	// Windowing and summing, as the full rate U without storing it
+	for (i = 0; i < 16 * M; i += 2 * M) {
+		for (j = 0; j < M; j += 4) {
+			__m128 f4_U = _mm_mul_ps(_mm_load_ps(&V[i * 2 + j]), _mm_load_ps(&D[i + j]));
+			f4_U = _mm_add_ps(f4_U, _mm_mul_ps(_mm_load_ps(&V[i * 2 + 3 * M + j]), _mm_load_ps(&D[i + M + j])));
+			f4_sum[j / 4] = _mm_add_ps(f4_sum[j / 4], f4_U);
 		}
-		*off += 16;
 	}
-#else
-	write_f4_s2_samples(f_tmp, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 4, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 8, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 12, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 16, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 20, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 24, nch, (short*)(pcm_buf + *off), off);
-	write_f4_s2_samples(f_tmp + 28, nch, (short*)(pcm_buf + *off), off);
-#endif
+
+	write_samples(f4_sum, M / 4, ch, nch, pcm);
+}
+
+// the 32 samples go through the float writers, which keeps the rounding of SAMPLE_F32 at 2^-24
+void synthesis_subband_filter_ref(const double s[32], const uint8_t ch, const uint8_t nch, struct pcm_stream* const pcm)
+{
+	double* const V = _V_ref[ch];
+	double sum[32] = { 0 };
+	__m128 f4_sum[8];
+	int i, j, k;
+
+	memmove(V + 64, V, 960 * sizeof(double));
+
+	for (i = 0; i < 64; ++i) {
+		V[i] = 0;
+		for (k = 0; k < 32; ++k)
+			V[i] += _N_ref[i][k] * s[k];
+	}
+
+	for (i = 0; i < 8; ++i) {
+		for (j = 0; j < 32; ++j) {
+			sum[j] += V[128 * i + j] * _D[64 * i + j];
+			sum[j] += V[128 * i + 96 + j] * _D[64 * i + 32 + j];
+		}
+	}
+
+	for (i = 0; i < 8; ++i)
+		f4_sum[i] = _mm_setr_ps((float)sum[4 * i], (float)sum[4 * i + 1], (float)sum[4 * i + 2], (float)sum[4 * i + 3]);
+	write_samples(f4_sum, 8, ch, nch, pcm);
 }
@@ -3,8 +3,22 @@
 
 #include "audio.h"
 
+// static buffers handed to the SIMD kernels, e.g. the s[32] of the synthesis
+#ifdef _MSC_VER
+#define MMP_ALIGN(_N) __declspec(align(_N))
+#else
+#define MMP_ALIGN(_N) __attribute__((aligned(_N)))
+#endif
+
 void init_synthesis_tabs(void);
 //void synthesis_subband_filter(const float samples_in[32], unsigned char pcm_out[32 * 2 * 2], unsigned pcm_out_index[2], int ch, int nch);
-void synthesis_subband_filter(const float s[32], const uint8_t ch, const uint8_t nch, uint8_t* pcm_buf, uint32_t* off);
+// s: one time slot of the 32 subbands, 16 byte aligned
+void synthesis_subband_filter(const float s[32], const uint8_t ch, const uint8_t nch, struct pcm_stream* const pcm);
+// both channels of a stereo stream at once, the same output as a synthesis_subband_filter call per channel
+void synthesis_subband_filter_stereo(const float s0[32], const float s1[32], struct pcm_stream* const pcm);
+// half (shift 1) or quarter (shift 2) rate output from the lowest 16 or 8 subbands
+void synthesis_subband_filter_reduced(const float s[32], const uint8_t ch, const uint8_t nch, const uint8_t shift, struct pcm_stream* const pcm);
+// double precision reference of synthesis_subband_filter, see DECODE_REFERENCE
+void synthesis_subband_filter_ref(const double s[32], const uint8_t ch, const uint8_t nch, struct pcm_stream* const pcm);
 
 #endif // !_MMP_SYNTH_H_
@@ -10,7 +10,7 @@ static void safe_print(const char* str, int len)
 
 void decode_id3v1(struct bs* const bstream)
 {
-	if (fseek(bstream->file_ptr, -128, SEEK_END))
+	if (bs_Seek(bstream, -128, SEEK_END))
 		return;
 
 	if (bs_Prefect(bstream, 128) == 128) {
@@ -41,11 +41,11 @@ void decode_id3v1(struct bs* const bstream)
 		}
 	}
 
-	fseek(bstream->file_ptr, 0, SEEK_SET);
+	bs_Seek(bstream, 0, SEEK_SET);
 	bstream->end_ptr = bstream->bit_buf;
 }
 
-int decode_id3v2(struct bs* const bstream, uint32_t* const size)
+int decode_id3v2(struct bs* const bstream, uint32_t* const size, const int verbose)
 {
 	if (bs_Prefect(bstream, 10) != 10)
 		return -1;
@@ -64,10 +64,11 @@ int decode_id3v2(struct bs* const bstream, uint32_t* const size)
 	*size <<= 7;
 	*size |= bstream->byte_ptr[9];
 
-	printf("ID3 2.%d%d\n" \
-		"flag: 0x%x\n" \
-		"size: %ubytes\n\n",
-		bstream->byte_ptr[3], bstream->byte_ptr[4], bstream->byte_ptr[5], *size + 10);
+	if (verbose)
+		printf("ID3 2.%d%d\n" \
+			"flag: 0x%x\n" \
+			"size: %ubytes\n\n",
+			bstream->byte_ptr[3], bstream->byte_ptr[4], bstream->byte_ptr[5], *size + 10);
 
 	return 0;
 }
@@ -87,7 +88,7 @@ static uint32_t byte2uint(const struct bs* const stream, int off)
 	return i;
 }
 
-int get_vbr_tag(const struct bs* const bstream, const struct mpeg_frame* const frame)
+int get_vbr_tag(const struct bs* const bstream, const struct mpeg_frame* const frame, const int verbose)
 {
 	if (frame->header.version != VERSION_10 || frame->header.layer != LAYER_3)
 		return -1;
@@ -95,11 +96,14 @@ int get_vbr_tag(const struct bs* const bstream, const struct mpeg_frame* const f
 	uint32_t off = frame->sideinfo_size;
 	uint32_t tag_magic = *(uint32_t*)(bstream->byte_ptr + off);
 
+	if (tag_magic != VBR_TAG_INFO && tag_magic != VBR_TAG_XING)
+		return -1;
+	if (!verbose)
+		return 0;
+
 	if (tag_magic == VBR_TAG_INFO)
 		puts("Info - CBR (Constant Bit Rate)");
-	else if (tag_magic == VBR_TAG_XING)
-		puts("Xing - VBR/ABR (Variable Bit Rate/Average Bit Rate)");
-	else return -1;
+	else puts("Xing - VBR/ABR (Variable Bit Rate/Average Bit Rate)");
 	off += 4;
 
 	unsigned char flags = bstream->byte_ptr[off + 3];
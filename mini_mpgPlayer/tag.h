@@ -5,7 +5,8 @@
 #include "frame.h"
 
 void decode_id3v1(struct bs* const bstream);
-int decode_id3v2(struct bs* const bstream, uint32_t* const size);
-int get_vbr_tag(const struct bs* const bstream, const struct mpeg_frame* frame);
+// verbose: print the tag fields to stdout
+int decode_id3v2(struct bs* const bstream, uint32_t* const size, const int verbose);
+int get_vbr_tag(const struct bs* const bstream, const struct mpeg_frame* frame, const int verbose);
 
 #endif // !_MMP_TAG_H_
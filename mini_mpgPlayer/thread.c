@@ -0,0 +1,254 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	// pthread_setaffinity_np
+#endif
+#include "thread.h"
+#include <stdlib.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <time.h>
+#endif
+
+struct thread_start {
+	thread_proc proc;
+	void* arg;
+};
+
+#ifdef _WIN32
+
+static DWORD WINAPI thread_entry(LPVOID param)
+{
+	struct thread_start start = *(struct thread_start*)param;
+	free(param);
+	return (DWORD)start.proc(start.arg);
+}
+
+int thread_Create(mmp_thread* const thread, const thread_proc proc, void* const arg)
+{
+	struct thread_start* start = malloc(sizeof(struct thread_start));
+	if (!start)
+		return -1;
+	start->proc = proc;
+	start->arg = arg;
+
+	if (!(*thread = CreateThread(NULL, 0, thread_entry, start, 0, NULL))) {
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+void thread_Join(mmp_thread thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+int thread_PinCurrent(const uint32_t cpu)
+{
+	if (cpu >= sizeof(DWORD_PTR) * 8)
+		return -1;
+
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) ? 0 : -1;
+}
+
+void mutex_Init(mmp_mutex* const mutex)
+{
+	InitializeSRWLock(mutex);
+}
+
+void mutex_Destroy(mmp_mutex* const mutex)
+{
+	(void)mutex;
+}
+
+void mutex_Lock(mmp_mutex* const mutex)
+{
+	AcquireSRWLockExclusive(mutex);
+}
+
+void mutex_Unlock(mmp_mutex* const mutex)
+{
+	ReleaseSRWLockExclusive(mutex);
+}
+
+void cond_Init(mmp_cond* const cond)
+{
+	InitializeConditionVariable(cond);
+}
+
+void cond_Destroy(mmp_cond* const cond)
+{
+	(void)cond;
+}
+
+void cond_Wait(mmp_cond* const cond, mmp_mutex* const mutex)
+{
+	SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+void cond_Signal(mmp_cond* const cond)
+{
+	WakeConditionVariable(cond);
+}
+
+void cond_Broadcast(mmp_cond* const cond)
+{
+	WakeAllConditionVariable(cond);
+}
+
+uint32_t atomic_Load(volatile uint32_t* const p)
+{
+	return (uint32_t)InterlockedOr((volatile LONG*)p, 0);
+}
+
+void atomic_Store(volatile uint32_t* const p, const uint32_t v)
+{
+	InterlockedExchange((volatile LONG*)p, (LONG)v);
+}
+
+uint64_t clock_Nanos(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000u + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000u / freq.QuadPart;
+}
+
+// Sleep() has a coarse granularity, sleep short of the deadline and yield the rest
+void sleep_Until(const uint64_t deadline)
+{
+	uint64_t now;
+
+	while ((now = clock_Nanos()) < deadline) {
+		const DWORD ms = (DWORD)((deadline - now) / 1000000);
+		Sleep(ms > 1 ? ms - 1 : 0);
+	}
+}
+
+#else
+
+static void* thread_entry(void* param)
+{
+	struct thread_start start = *(struct thread_start*)param;
+	free(param);
+	return (void*)(intptr_t)start.proc(start.arg);
+}
+
+int thread_Create(mmp_thread* const thread, const thread_proc proc, void* const arg)
+{
+	struct thread_start* start = malloc(sizeof(struct thread_start));
+	if (!start)
+		return -1;
+	start->proc = proc;
+	start->arg = arg;
+
+	if (pthread_create(thread, NULL, thread_entry, start)) {
+		free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+void thread_Join(mmp_thread thread)
+{
+	pthread_join(thread, NULL);
+}
+
+int thread_PinCurrent(const uint32_t cpu)
+{
+#ifdef __linux__
+	cpu_set_t set;
+
+	if (cpu >= CPU_SETSIZE)
+		return -1;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) ? -1 : 0;
+#else
+	(void)cpu;
+	return -1;
+#endif
+}
+
+void mutex_Init(mmp_mutex* const mutex)
+{
+	pthread_mutex_init(mutex, NULL);
+}
+
+void mutex_Destroy(mmp_mutex* const mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+void mutex_Lock(mmp_mutex* const mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+void mutex_Unlock(mmp_mutex* const mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+void cond_Init(mmp_cond* const cond)
+{
+	pthread_cond_init(cond, NULL);
+}
+
+void cond_Destroy(mmp_cond* const cond)
+{
+	pthread_cond_destroy(cond);
+}
+
+void cond_Wait(mmp_cond* const cond, mmp_mutex* const mutex)
+{
+	pthread_cond_wait(cond, mutex);
+}
+
+void cond_Signal(mmp_cond* const cond)
+{
+	pthread_cond_signal(cond);
+}
+
+void cond_Broadcast(mmp_cond* const cond)
+{
+	pthread_cond_broadcast(cond);
+}
+
+uint32_t atomic_Load(volatile uint32_t* const p)
+{
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+void atomic_Store(volatile uint32_t* const p, const uint32_t v)
+{
+	__atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+uint64_t clock_Nanos(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void sleep_Until(const uint64_t deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(deadline / 1000000000u);
+	ts.tv_nsec = (long)(deadline % 1000000000u);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+#endif
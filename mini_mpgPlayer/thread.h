@@ -0,0 +1,44 @@
+#ifndef _MMP_THREAD_H_
+#define _MMP_THREAD_H_ 1
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+typedef SRWLOCK mmp_mutex;
+typedef CONDITION_VARIABLE mmp_cond;
+typedef HANDLE mmp_thread;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t mmp_mutex;
+typedef pthread_cond_t mmp_cond;
+typedef pthread_t mmp_thread;
+#endif
+
+typedef int (*thread_proc)(void* arg);
+
+int thread_Create(mmp_thread* const thread, const thread_proc proc, void* const arg);
+void thread_Join(mmp_thread thread);
+// run the calling thread on one logical processor only
+int thread_PinCurrent(const uint32_t cpu);
+
+void mutex_Init(mmp_mutex* const mutex);
+void mutex_Destroy(mmp_mutex* const mutex);
+void mutex_Lock(mmp_mutex* const mutex);
+void mutex_Unlock(mmp_mutex* const mutex);
+
+void cond_Init(mmp_cond* const cond);
+void cond_Destroy(mmp_cond* const cond);
+void cond_Wait(mmp_cond* const cond, mmp_mutex* const mutex);
+void cond_Signal(mmp_cond* const cond);
+void cond_Broadcast(mmp_cond* const cond);
+
+// sequentially consistent
+uint32_t atomic_Load(volatile uint32_t* const p);
+void atomic_Store(volatile uint32_t* const p, const uint32_t v);
+
+// monotonic clock, nanoseconds from an arbitrary origin
+uint64_t clock_Nanos(void);
+void sleep_Until(const uint64_t deadline);
+
+#endif // !_MMP_THREAD_H_
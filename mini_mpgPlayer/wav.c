@@ -0,0 +1,191 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "wav.h"
+#include "ring.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAV_HEADER_SIZE	44
+#define WAV_HEADER_SIZE_EXT	68	// WAVE_FORMAT_EXTENSIBLE
+#define WAV_BLOCK_SIZE	(256 * 1024)
+#define WAV_BLOCKS	4
+
+struct wav_sink {
+	FILE* fp;
+	struct pcm_ring* ring;
+	mmp_thread writer;
+	int started;
+
+	uint8_t* block;	// producer block being filled
+	uint32_t fill;
+
+	uint64_t data_size;
+	uint32_t rate;
+	uint16_t channels;
+	enum SAMPLE_FORMAT format;
+	uint32_t header_size;
+	int raw;
+	volatile uint32_t failed;
+};
+
+static void put_le16(uint8_t* p, const uint16_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t* p, const uint32_t v)
+{
+	put_le16(p, (uint16_t)v);
+	put_le16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void make_header(const struct wav_sink* const sink, uint8_t* h, const uint32_t data_size)
+{
+	const uint16_t bits = sink->format == SAMPLE_S16 ? 16 : 32;
+	const uint16_t block_align = sink->channels * bits / 8;
+	const uint32_t fmt_size = sink->header_size - 28;
+
+	memcpy(h, "RIFF", 4);
+	put_le32(h + 4, data_size > UINT32_MAX - (sink->header_size - 8) ? UINT32_MAX : data_size + sink->header_size - 8);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	put_le32(h + 16, fmt_size);
+	put_le16(h + 20, sink->header_size == WAV_HEADER_SIZE ? 1 : 0xfffe);
+	put_le16(h + 22, sink->channels);
+	put_le32(h + 24, sink->rate);
+	put_le32(h + 28, sink->rate * block_align);
+	put_le16(h + 32, block_align);
+	put_le16(h + 34, bits);
+	if (sink->header_size == WAV_HEADER_SIZE_EXT) {
+		// 24 valid bits in a 32-bit container and float: WAVEFORMATEXTENSIBLE with the KSDATAFORMAT_SUBTYPE guid
+		static const uint8_t guid_tail[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 };
+		put_le16(h + 36, 22);
+		put_le16(h + 38, sink->format == SAMPLE_S24_32 ? 24 : 32);
+		put_le32(h + 40, sink->channels == 1 ? 0x4 : 0x3);
+		put_le16(h + 44, sink->format == SAMPLE_F32 ? 3 : 1);
+		memcpy(h + 46, guid_tail, sizeof(guid_tail));
+	}
+	memcpy(h + fmt_size + 20, "data", 4);
+	put_le32(h + fmt_size + 24, data_size);
+}
+
+/*
+* Every write is a whole block at a block-aligned file offset (the header is part of the first one),
+* and stdio buffering is off so the block goes to the OS without another copy.
+*/
+static int wav_writer(void* arg)
+{
+	struct wav_sink* const sink = arg;
+	const uint8_t* block;
+	uint32_t len;
+
+	while ((block = ring_beginRead(sink->ring, &len, 1))) {
+		if (!sink->failed && fwrite(block, 1, len, sink->fp) != len)
+			atomic_Store(&sink->failed, 1);
+		ring_endRead(sink->ring);
+	}
+
+	return 0;
+}
+
+struct wav_sink* wav_Open(const char* const file_name, const int raw)
+{
+	struct wav_sink* sink = NULL;
+
+	do {
+		if (!(sink = calloc(1, sizeof(struct wav_sink))))
+			break;
+		if (!(sink->fp = fopen(file_name, "wb")))
+			break;
+		setvbuf(sink->fp, NULL, _IONBF, 0);
+		if (!(sink->ring = ring_Init(WAV_BLOCKS, WAV_BLOCK_SIZE, WAV_BLOCKS - 1, WAV_BLOCKS)))
+			break;
+		if (thread_Create(&sink->writer, wav_writer, sink) == -1)
+			break;
+		sink->started = 1;
+
+		sink->raw = raw;
+		sink->block = ring_beginWrite(sink->ring);
+
+		return sink;
+	} while (0);
+
+	wav_Close(&sink);
+	return NULL;
+}
+
+int wav_Close(struct wav_sink** const sink)
+{
+	int ret = 0;
+
+	if (sink && *sink) {
+		struct wav_sink* const s = *sink;
+
+		if (s->started) {
+			if (s->fill)
+				ring_endWrite(s->ring, s->fill);
+			ring_Close(s->ring);
+			thread_Join(s->writer);
+		}
+		ring_Release(&s->ring);
+
+		if (s->fp) {
+			if (s->started && s->header_size && !s->failed) {
+				uint8_t header[WAV_HEADER_SIZE_EXT];
+				make_header(s, header, s->data_size > UINT32_MAX ? UINT32_MAX : (uint32_t)s->data_size);
+				if (fseek(s->fp, 0, SEEK_SET) || fwrite(header, 1, s->header_size, s->fp) != s->header_size)
+					s->failed = 1;
+			}
+			if (fclose(s->fp))
+				s->failed = 1;
+		}
+
+		ret = s->failed ? -1 : 0;
+		free(s);
+		*sink = NULL;
+	}
+
+	return ret;
+}
+
+void wav_setFormat(struct wav_sink* const sink, uint32_t rate, uint16_t channels, enum SAMPLE_FORMAT format)
+{
+	sink->rate = rate;
+	sink->channels = channels;
+	sink->format = format;
+
+	if (!sink->raw && !sink->header_size) {
+		sink->header_size = format == SAMPLE_S16 ? WAV_HEADER_SIZE : WAV_HEADER_SIZE_EXT;
+		memset(sink->block, 0, sink->header_size);	// patched on close
+		sink->fill = sink->header_size;
+	}
+}
+
+int wav_Write(struct wav_sink* const sink, const void* data, uint32_t len)
+{
+	const uint8_t* src = data;
+
+	if (atomic_Load(&sink->failed))
+		return -1;
+
+	sink->data_size += len;
+	while (len) {
+		uint32_t n = WAV_BLOCK_SIZE - sink->fill;
+		if (n > len)
+			n = len;
+		memcpy(sink->block + sink->fill, src, n);
+		sink->fill += n;
+		src += n;
+		len -= n;
+
+		if (sink->fill == WAV_BLOCK_SIZE) {
+			ring_endWrite(sink->ring, WAV_BLOCK_SIZE);
+			sink->block = ring_beginWrite(sink->ring);
+			sink->fill = 0;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef _MMP_WAV_H_
+#define _MMP_WAV_H_ 1
+
+#include "audio.h"
+#include <stdint.h>
+
+/*
+* RIFF/WAVE (or headerless) file sink.
+* Writes are copied into large blocks which a writer thread flushes to disk,
+* so the decoding thread only blocks when the disk falls behind by a whole ring of blocks.
+*/
+struct wav_sink;
+
+struct wav_sink* wav_Open(const char* const file_name, const int raw);
+// the header is patched with the final sizes, returns -1 if any write failed
+int wav_Close(struct wav_sink** const sink);
+
+// once, before the first wav_Write
+void wav_setFormat(struct wav_sink* const sink, uint32_t rate, uint16_t channels, enum SAMPLE_FORMAT format);
+int wav_Write(struct wav_sink* const sink, const void* data, uint32_t len);
+
+#endif // !_MMP_WAV_H_